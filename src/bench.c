@@ -0,0 +1,206 @@
+#include "bench.h"
+#include "kernels.h"
+#include "slip.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_ITERS 200000
+
+static uint8_t bench_src[4096] __attribute__((aligned(64)));
+static uint8_t bench_dst[4096] __attribute__((aligned(64)));
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Each case is timed for every kernel set the CPU supports. 'arg' selects the
+// span length so one case can cover both long rows and glyph-sized spans.
+typedef struct {
+    const char *name;
+    int arg;
+    void (*run)(const PixelKernels *k, int arg, int i);
+} BenchCase;
+
+static void run_fill16(const PixelKernels *k, int n, int i) {
+    k->fill16((uint16_t*)bench_dst + (i & 7), (uint16_t)i, n);
+}
+
+static void run_fill32(const PixelKernels *k, int n, int i) {
+    k->fill32((uint32_t*)bench_dst + (i & 7), (uint32_t)i, n);
+}
+
+static void run_glyph16(const PixelKernels *k, int n, int i) {
+    k->glyph16((uint16_t*)bench_dst + (i & 7), (uint32_t)i * 0x9E3779B9u, n, 0xFFFF, 0x0000, i & 1);
+}
+
+static void run_glyph32(const PixelKernels *k, int n, int i) {
+    k->glyph32((uint32_t*)bench_dst + (i & 7), (uint32_t)i * 0x9E3779B9u, n, 0xFFFFFFFF, 0xFF000000, i & 1);
+}
+
+static void run_copy(const PixelKernels *k, int n, int i) {
+    k->copy_row(bench_dst + (i & 7) * 4, bench_src, n);
+}
+
+static const uint32_t bench_lut[256];
+static const int bench_map[512];
+
+static void run_expand16(const PixelKernels *k, int n, int i) {
+    k->expand16((uint16_t*)bench_dst + (i & 7), bench_src, n, bench_lut);
+}
+
+static void run_expand32(const PixelKernels *k, int n, int i) {
+    k->expand32((uint32_t*)bench_dst + (i & 7), bench_src, n, bench_lut);
+}
+
+static void run_scale16(const PixelKernels *k, int n, int i) {
+    k->scale16((uint16_t*)bench_dst + (i & 7), (const uint16_t*)bench_src, n, 2);
+}
+
+static void run_scale32(const PixelKernels *k, int n, int i) {
+    k->scale32((uint32_t*)bench_dst + (i & 7), (const uint32_t*)bench_src, n, 2);
+}
+
+static void run_remap32(const PixelKernels *k, int n, int i) {
+    k->remap32((uint32_t*)bench_dst + (i & 7), (const uint32_t*)bench_src, bench_map, n);
+}
+
+static void run_transpose16(const PixelKernels *k, int n, int i) {
+    k->transpose16((uint16_t*)bench_dst + (i & 7), n, (const uint16_t*)bench_src, n, n, n);
+}
+
+static void run_transpose32(const PixelKernels *k, int n, int i) {
+    k->transpose32((uint32_t*)bench_dst + (i & 7), n, (const uint32_t*)bench_src, n, n, n);
+}
+
+static void run_pack24(const PixelKernels *k, int n, int i) {
+    k->pack24(bench_dst + (i & 7) * 3, (const uint32_t*)bench_src, n);
+}
+
+static const BenchCase bench_cases[] = {
+    { "fill16 row (320 px)",    320, run_fill16 },
+    { "fill16 span (12 px)",     12, run_fill16 },
+    { "fill32 row (320 px)",    320, run_fill32 },
+    { "fill32 span (12 px)",     12, run_fill32 },
+    { "glyph16 row (8 px)",       8, run_glyph16 },
+    { "glyph16 row (12 px)",     12, run_glyph16 },
+    { "glyph32 row (8 px)",       8, run_glyph32 },
+    { "glyph32 row (12 px)",     12, run_glyph32 },
+    { "copy row (640 B)",       640, run_copy },
+    { "copy row (1280 B)",     1280, run_copy },
+    { "expand16 row (320 px)",  320, run_expand16 },
+    { "expand32 row (320 px)",  320, run_expand32 },
+    { "scale16 2x (320 px)",    320, run_scale16 },
+    { "scale32 2x (160 px)",    160, run_scale32 },
+    { "remap32 (480 px)",       480, run_remap32 },
+    { "transpose16 (16x16)",     16, run_transpose16 },
+    { "transpose32 (16x16)",     16, run_transpose32 },
+    { "pack24 row (320 px)",    320, run_pack24 },
+};
+
+static double time_case(const BenchCase *c, const PixelKernels *k) {
+    // Warm up caches and branch predictors first
+    for (int i = 0; i < 1000; i++) c->run(k, c->arg, i);
+    double t0 = now_ns();
+    for (int i = 0; i < BENCH_ITERS; i++) c->run(k, c->arg, i);
+    return (now_ns() - t0) / BENCH_ITERS;
+}
+
+// --- SLIP decoder ---
+// A synthetic M8 stream: mostly rect and char commands, a waveform now and
+// then, and some payload bytes that need escaping. Both decoders must see the
+// same frames, the checksum guards against the buffer path dropping any.
+#define SLIP_STREAM_SIZE (256 * 1024)
+#define SLIP_PASSES 40
+
+static uint8_t slip_stream[SLIP_STREAM_SIZE + 1024];
+static uint8_t slip_rx[1024];
+static uint32_t slip_frames, slip_sum;
+
+static int count_frame(uint8_t *data, uint32_t size) {
+    slip_frames++;
+    slip_sum = slip_sum * 31 + size + (size ? data[0] + data[size - 1] : 0);
+    return 1;
+}
+
+static uint32_t build_slip_stream(void) {
+    uint32_t n = 0, seed = 1;
+    while (n < SLIP_STREAM_SIZE) {
+        seed = seed * 1103515245u + 12345;
+        int kind = (seed >> 16) % 100;
+        int len = (kind < 2) ? 484 : 12;
+        for (int i = 0; i < len; i++) {
+            seed = seed * 1103515245u + 12345;
+            uint8_t b = (i == 0) ? ((kind < 2) ? 0xFC : (kind & 1) ? 0xFE : 0xFD) : (uint8_t)(seed >> 20);
+            if (b == SLIP_SPECIAL_BYTE_END) { slip_stream[n++] = SLIP_SPECIAL_BYTE_ESC; b = SLIP_ESCAPED_BYTE_END; }
+            else if (b == SLIP_SPECIAL_BYTE_ESC) { slip_stream[n++] = SLIP_SPECIAL_BYTE_ESC; b = SLIP_ESCAPED_BYTE_ESC; }
+            slip_stream[n++] = b;
+        }
+        slip_stream[n++] = SLIP_SPECIAL_BYTE_END;
+    }
+    return n;
+}
+
+// Feeds the stream in serial_read()-sized chunks, 'bulk' picks the decoder
+static double time_slip(uint32_t n, int chunk, bool bulk, uint32_t *frames, uint32_t *sum) {
+    static const slip_descriptor_s desc = { slip_rx, sizeof(slip_rx), count_frame };
+    slip_handler_s slip;
+    slip_init(&slip, &desc);
+    slip_frames = slip_sum = 0;
+    double t0 = now_ns();
+    for (int pass = 0; pass < SLIP_PASSES; pass++) {
+        for (uint32_t pos = 0; pos < n; pos += chunk) {
+            uint32_t len = (n - pos < (uint32_t)chunk) ? n - pos : (uint32_t)chunk;
+            if (bulk) slip_read_buffer(&slip, slip_stream + pos, len);
+            else for (uint32_t i = 0; i < len; i++) slip_read_byte(&slip, slip_stream[pos + i]);
+        }
+    }
+    double ns = now_ns() - t0;
+    *frames = slip_frames;
+    *sum = slip_sum;
+    return (double)n * SLIP_PASSES / ns * 1e9 / (1024 * 1024);
+}
+
+static void bench_slip(void) {
+    uint32_t n = build_slip_stream();
+    printf("\n%-24s%12s%12s%12s\n", "SLIP decode (MB/s)", "byte", "buffer", "buffer/byte");
+    static const int chunks[] = { 256, 4096 };
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        uint32_t f1, s1, f2, s2;
+        double byte = time_slip(n, chunks[c], false, &f1, &s1);
+        double bulk = time_slip(n, chunks[c], true, &f2, &s2);
+        char name[32];
+        snprintf(name, sizeof(name), "%d B reads", chunks[c]);
+        printf("%-24s%12.1f%12.1f%11.2fx%s\n", name, byte, bulk, byte > 0 ? bulk / byte : 0.0,
+               (f1 != f2 || s1 != s2) ? "  MISMATCH" : "");
+    }
+}
+
+int bench_run(void) {
+    const PixelKernels *sets[4];
+    int count = kernels_available(sets, 4);
+    kernels_init("scalar");
+
+    for (size_t i = 0; i < sizeof(bench_src); i++) bench_src[i] = (uint8_t)(i * 31);
+
+    printf("\n%-24s", "kernel (ns/call)");
+    for (int s = 0; s < count; s++) printf("%12s", sets[s]->name);
+    printf("%12s\n", "best/scalar");
+
+    for (size_t c = 0; c < sizeof(bench_cases) / sizeof(bench_cases[0]); c++) {
+        double scalar = 0, best = 0;
+        printf("%-24s", bench_cases[c].name);
+        for (int s = 0; s < count; s++) {
+            double ns = time_case(&bench_cases[c], sets[s]);
+            if (s == 0) scalar = best = ns;
+            if (ns < best) best = ns;
+            printf("%12.2f", ns);
+        }
+        printf("%11.2fx\n", best > 0 ? scalar / best : 0.0);
+    }
+
+    bench_slip();
+    return 0;
+}
@@ -0,0 +1,8 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// Microbenchmarks for the hot paths, run with: ./m8alt --bench
+// Needs no M8, framebuffer or config; results go to stdout.
+int bench_run(void);
+
+#endif
@@ -4,8 +4,10 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-#define M8_WIDTH 320
-#define M8_HEIGHT 240
+// Largest M8 screen (Model:02, 480x320). The older models are 320x240; the
+// geometry in use is picked at runtime from the system info packet.
+#define M8_MAX_WIDTH 480
+#define M8_MAX_HEIGHT 320
 
 // Global Dirty Flag (set by Serial, read by Main/Display)
 extern bool g_dirty;
@@ -16,6 +18,32 @@ typedef struct {
     char fb_path[64];
     char input_path[64];
     int key_map[8]; // UP, DOWN, LEFT, RIGHT, SELECT, START, OPT, EDIT
+    int stats_interval; // Seconds between performance stat printouts (0 = off)
+    int rotation;       // Clockwise rotation applied at blit time: 0, 90, 180, 270
+    int serial_read_size;   // Bytes per read() from the M8 port
+    int serial_read_budget; // Bytes drained per wakeup before input/blit get a turn (0 = no limit)
+    int serial_thread;      // 1 = read and decode the port on its own thread
+    int serial_queue_kb;    // Decoded command queue between that thread and the main loop
+    char record_file[128];  // Capture the raw serial stream here ("" = off), see record.h
+    int record_buffer_kb;   // Memory between the serial side and the recorder's writer thread
+    int blit_mode;      // BlitMode: 0 = copy, 1 = diff against shadow, 2 = page-aware diff
+    int page_flip;      // Double buffer via FBIOPAN_DISPLAY when yres_virtual allows
+    int vsync_pacing;   // Blit on vsync ticks from a helper thread/timer instead of waiting inline
+    int vsync_hz;       // Timer rate used when the driver has no FBIO_WAITFORVSYNC
+    char kernels[16];   // Pixel kernel set: auto, scalar, sse2, avx2, neon
+    int indexed;        // 8-bit palette-indexed render buffer, expanded at blit time
+    char scale[8];      // Output scaling: 1 (off), 2/3/4, int (largest integer), fit
+    char video_mode[16]; // FBIOPUT_VSCREENINFO mode to switch to, e.g. 640x480 ("" = keep)
+    char backend[16];   // Display backend: fbdev, drm (KMS atomic page flips), offscreen
+    char drm_path[64];  // DRM card used by the drm backend
+    char offscreen_path[64]; // File the offscreen backend renders into ("" = memfd)
+    int offscreen_bpp;  // Offscreen pixel depth (16, 24 or 32), resolution from video_mode
+    int offscreen_line_length; // Offscreen bytes per row (0 = packed)
+    int draw_batch;     // Queue draw commands per frame, cull overdrawn ones before rasterising
+    int frame_gap_ms;   // Serial idle time that ends a frame (0 = blit after every read)
+    int frame_deadline_ms; // Longest a frame is assembled before it is blitted anyway
+    int frame_on_waveform; // A waveform packet ends the frame
+    char direct_render[8]; // Rasterise straight into fb_mem: auto (fbtft), 1, 0
 } Config;
 
 extern Config app_config;
@@ -1,10 +1,15 @@
 #include "display.h"
 #include "common.h"
+#include "vsync.h"
+#include "kernels.h"
+#include "drm.h"
+#include "offscreen.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
@@ -18,15 +23,44 @@
 #include "fonts/font5.h"
 
 typedef struct {
+    int width;           // M8 screen: 320x240, or 480x320 on Model:02
+    int height;
+    int tile_cols;       // Damage tiles covering it
+    int tile_rows;
     int fb_fd;
     void *fb_mem;
     struct fb_var_screeninfo vinfo;
     struct fb_fix_screeninfo finfo;
-    void *render_buffer; // Void pointer to support 16 or 32 bit dynamically
+    void *render_buffer; // Void pointer to support 8 (indexed), 16 or 32 bit dynamically
+    void *shadow_buffer; // Copy of what was last pushed to each fb page (BLIT_DIFF)
+    bool shadow_valid[2]; // False until a full blit has refreshed that page's shadow
+    int pages;           // 2 when page flipping via FBIOPAN_DISPLAY, else 1
+    int back_page;       // Page being drawn into while the other one is shown
+    bool vsync_paced;    // Main loop blits on vsync ticks, so blit must not wait
+    int page_shift;      // log2 of the mmap page size, for page accounting
+    BlitMode blit_mode;
     int offset_x;
     int offset_y;
-    int bpp;             // Bytes per pixel (2 or 4)
-    int stride;          // Buffer stride in bytes (width * bpp)
+    int bpp;             // Working bytes per pixel (2 or 4), see init_pixel_format
+    int fbpp;            // Framebuffer bytes per pixel (3 when 24 bpp is rendered as 4)
+    int rbpp;            // Render buffer bytes per pixel (1 when indexed, else bpp)
+    int stride;          // Render buffer stride in bytes (width * rbpp)
+    int native_stride;   // Shadow/line buffer stride in bytes (width * bpp)
+    uint8_t *line_buffer; // One row expanded to native format (indexed mode)
+    bool scaled;         // Image is stretched to out_w x out_h (see init_scaling)
+    int scale_k;         // Integer scale factor, 0 for best-fit via col_map
+    int out_w;
+    int out_h;
+    uint8_t *scale_line; // One output row of scaled spans in native format
+    int rotation;        // Clockwise degrees applied at blit time (0, 90, 180, 270)
+    uint8_t *rot_strip;  // One output tile row, TILE_SIZE rows of out_w pixels
+    uint8_t *rot_block;  // One source tile expanded to native format (indexed mode)
+    bool mode_changed;   // video_mode was applied, restore saved_vinfo on close
+    struct fb_var_screeninfo saved_vinfo;
+    bool drm;            // Scanning out DRM dumb buffers instead of fbdev
+    uint8_t *page_mem[2]; // Start of each page (fbdev: halves of fb_mem)
+    bool offscreen;      // fb_fd is a memfd/file described by offscreen_open()
+    bool direct;         // render_buffer points into fb_mem, nothing to copy
 } Framebuffer;
 
 static Framebuffer g_fb;
@@ -36,168 +70,1545 @@ static int current_font_idx = 0;
 static uint32_t global_bg_color = 0; 
 static int prev_waveform_size = 0;
 
-// --- Optimization: Dirty Rectangle Tracking ---
-static int dirty_min_x = M8_WIDTH;
-static int dirty_min_y = M8_HEIGHT;
+// --- Optimization: Tile Damage Tracking ---
+// The screen is split into TILE_SIZE x TILE_SIZE cells. Each tile row keeps a
+// bitmask of dirty tile columns, so two small updates at opposite ends of the
+// screen no longer drag every pixel in between into the blit.
+#define TILE_SIZE 16
+#define TILE_SHIFT 4
+// Sized for the largest M8 screen, g_fb.tile_cols/tile_rows are in use
+#define TILE_COLS ((M8_MAX_WIDTH + TILE_SIZE - 1) / TILE_SIZE)
+#define TILE_ROWS ((M8_MAX_HEIGHT + TILE_SIZE - 1) / TILE_SIZE)
+
+static uint32_t dirty_tiles[TILE_ROWS];
+// Damage of the previous blit. With page flipping the back page missed it.
+static uint32_t prev_tiles[TILE_ROWS];
+
+// Bounding box of the same damage, only kept to report what the tiles save
+static int dirty_min_x = M8_MAX_WIDTH;
+static int dirty_min_y = M8_MAX_HEIGHT;
 static int dirty_max_x = -1;
 static int dirty_max_y = -1;
 
+static DisplayStats g_stats;
+
 // --- Helper Functions ---
 
+// Mark [x0, x1) x [y0, y1) dirty as is
+static inline void mark_region(int x0, int y0, int x1, int y1) {
+    // Clamp to screen bounds
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > g_fb.width) x1 = g_fb.width;
+    if (y1 > g_fb.height) y1 = g_fb.height;
+    if (x0 >= x1 || y0 >= y1) return;
+
+    if (x0 < dirty_min_x) dirty_min_x = x0;
+    if (y0 < dirty_min_y) dirty_min_y = y0;
+    if (x1 > dirty_max_x) dirty_max_x = x1;
+    if (y1 > dirty_max_y) dirty_max_y = y1;
+
+    int tx0 = x0 >> TILE_SHIFT;
+    int tx1 = (x1 - 1) >> TILE_SHIFT;
+    uint32_t mask = (0xFFFFFFFFu >> (31 - tx1)) & (0xFFFFFFFFu << tx0);
+    for (int ty = y0 >> TILE_SHIFT; ty <= (y1 - 1) >> TILE_SHIFT; ty++) {
+        dirty_tiles[ty] |= mask;
+    }
+}
+
 static inline void mark_dirty(int x, int y, int w, int h) {
     // Padding ensures artifacts (like text tails or offset mismatches) are cleared
     int pad_x = 2;
     int pad_y = 6; 
+    mark_region(x - pad_x, y - pad_y, x + w + pad_x, y + h + pad_y);
+}
 
-    int nx = x - pad_x;
-    int ny = y - pad_y;
-    int nw = w + (pad_x * 2);
-    int nh = h + (pad_y * 2);
+static inline void mark_all_dirty(void) {
+    dirty_min_x = 0; dirty_min_y = 0;
+    dirty_max_x = g_fb.width; dirty_max_y = g_fb.height;
+    uint32_t all = 0xFFFFFFFFu >> (32 - g_fb.tile_cols);
+    for (int ty = 0; ty < g_fb.tile_rows; ty++) dirty_tiles[ty] = all;
+}
 
-    if (nx < dirty_min_x) dirty_min_x = nx;
-    if (ny < dirty_min_y) dirty_min_y = ny;
-    if (nx + nw > dirty_max_x) dirty_max_x = nx + nw;
-    if (ny + nh > dirty_max_y) dirty_max_y = ny + nh;
-    
-    // Clamp to screen bounds
-    if (dirty_min_x < 0) dirty_min_x = 0;
-    if (dirty_min_y < 0) dirty_min_y = 0;
-    if (dirty_max_x > M8_WIDTH) dirty_max_x = M8_WIDTH;
-    if (dirty_max_y > M8_HEIGHT) dirty_max_y = M8_HEIGHT;
+static inline void clear_dirty(void) {
+    dirty_min_x = g_fb.width;
+    dirty_min_y = g_fb.height;
+    dirty_max_x = -1;
+    dirty_max_y = -1;
+    memset(dirty_tiles, 0, sizeof(dirty_tiles));
+}
+
+// --- Pixel Format ---
+// Colors are packed once per draw command, straight into the channel layout
+// the framebuffer reports (vinfo red/green/blue offset and length), so BGR
+// panels and 6-bit channels need no conversion at blit time. 24 bpp has no
+// pixel type to draw with: it is rendered as 32-bit words holding the packed
+// 24-bit value, and kern.pack24 narrows the damaged spans while blitting.
+typedef struct {
+    uint8_t shift[3];    // Right shift of the 8-bit M8 channel (8 - length)
+    uint8_t offset[3];
+    uint32_t fill;       // Bits outside the channels, set to 1 (alpha/padding)
+} PixelFormat;
+
+static PixelFormat g_fmt;
+
+static inline uint32_t bitfield_mask(const struct fb_bitfield* f) {
+    return (f->length >= 32) ? 0xFFFFFFFFu : ((1u << f->length) - 1) << f->offset;
+}
+
+static void init_pixel_format(void) {
+    int bits = g_fb.vinfo.bits_per_pixel;
+    g_fb.fbpp = bits / 8;
+    if (bits != 16 && bits != 24 && bits != 32) {
+        fprintf(stderr, "Display Error: %d bpp framebuffers are not supported\n", bits);
+        exit(5);
+    }
+    g_fb.bpp = (g_fb.fbpp == 3) ? 4 : g_fb.fbpp;
+
+    // Channels wider than the M8's 8 bits, overlapping or outside the pixel
+    // mean the driver did not fill the bitfields in: assume RGB565/RGB888
+    struct fb_bitfield ch[3] = { g_fb.vinfo.red, g_fb.vinfo.green, g_fb.vinfo.blue };
+    uint32_t used = 0;
+    bool valid = true;
+    for (int i = 0; i < 3; i++) {
+        if (ch[i].length == 0 || ch[i].length > 8 || ch[i].offset + ch[i].length > (uint32_t)bits ||
+            (used & bitfield_mask(&ch[i]))) valid = false;
+        else used |= bitfield_mask(&ch[i]);
+    }
+    if (!valid) {
+        if (bits == 16) {
+            ch[0] = (struct fb_bitfield){ 11, 5, 0 };
+            ch[1] = (struct fb_bitfield){ 5, 6, 0 };
+            ch[2] = (struct fb_bitfield){ 0, 5, 0 };
+        } else {
+            ch[0] = (struct fb_bitfield){ 16, 8, 0 };
+            ch[1] = (struct fb_bitfield){ 8, 8, 0 };
+            ch[2] = (struct fb_bitfield){ 0, 8, 0 };
+        }
+        used = bitfield_mask(&ch[0]) | bitfield_mask(&ch[1]) | bitfield_mask(&ch[2]);
+    }
+    for (int i = 0; i < 3; i++) {
+        g_fmt.shift[i] = 8 - ch[i].length;
+        g_fmt.offset[i] = ch[i].offset;
+    }
+
+    // 32 bpp pixels always had their alpha/padding byte opaque
+    g_fmt.fill = 0;
+    if (bits == 32) g_fmt.fill = ~used;
+    else if (g_fb.vinfo.transp.length) g_fmt.fill = bitfield_mask(&g_fb.vinfo.transp) & ~used;
+
+    bool standard = (ch[0].offset > ch[2].offset) &&
+                    ((bits == 16 && ch[0].length == 5 && ch[1].length == 6 && ch[2].length == 5) ||
+                     (bits == 32 && ch[0].length == 8 && ch[1].length == 8 && ch[2].length == 8));
+    if (!standard) {
+        printf("Display: %d bpp, %s %d-%d-%d%s\n", bits, (ch[0].offset > ch[2].offset) ? "RGB" : "BGR",
+               ch[0].length, ch[1].length, ch[2].length,
+               (g_fb.fbpp != g_fb.bpp) ? ", rendered as 32 bpp and packed at blit time" : "");
+    }
+}
+
+// Convert M8 RGB (8-8-8) to the native format
+static inline uint32_t pack_native(uint8_t r, uint8_t g, uint8_t b) {
+    return g_fmt.fill |
+           ((uint32_t)(r >> g_fmt.shift[0]) << g_fmt.offset[0]) |
+           ((uint32_t)(g >> g_fmt.shift[1]) << g_fmt.offset[1]) |
+           ((uint32_t)(b >> g_fmt.shift[2]) << g_fmt.offset[2]);
+}
+
+// --- Optimization: Palette-Indexed Render Buffer ---
+// The M8 only uses a handful of colors, so the render buffer can hold one
+// byte per pixel and be expanded through a LUT at blit time. Entries are keyed
+// by the native color, so two RGB values that pack to the same RGB565 share an
+// index and color comparisons behave exactly as in native mode.
+//
+// Overflow policy when a 257th color shows up:
+//   1. A full-screen clear always restarts the palette with just its color.
+//   2. Otherwise indices no longer present in the render buffer are reclaimed.
+//   3. If all 256 are really on screen, the buffer is converted to native
+//      format for the rest of the session.
+#define PALETTE_SIZE 256
+#define PALETTE_HASH 512
+
+typedef struct {
+    int count;
+    uint32_t native[PALETTE_SIZE];   // Index -> native color, the blit LUT
+    int16_t hash[PALETTE_HASH];      // Open addressing, native color -> index
+} Palette;
+
+static Palette g_pal;
+
+static inline uint32_t palette_hash(uint32_t native) {
+    return (native * 2654435761u) >> 23; // 9 bits
+}
+
+static void palette_rehash(void) {
+    memset(g_pal.hash, 0xFF, sizeof(g_pal.hash));
+    for (int i = 0; i < g_pal.count; i++) {
+        uint32_t h = palette_hash(g_pal.native[i]);
+        while (g_pal.hash[h] >= 0) h = (h + 1) & (PALETTE_HASH - 1);
+        g_pal.hash[h] = i;
+    }
+}
+
+static void palette_reset(void) {
+    g_pal.count = 0;
+    memset(g_pal.hash, 0xFF, sizeof(g_pal.hash));
+}
+
+// Caller guarantees room (palette_reserve) before packing new colors
+static inline uint8_t palette_index(uint32_t native) {
+    uint32_t h = palette_hash(native);
+    while (g_pal.hash[h] >= 0) {
+        if (g_pal.native[g_pal.hash[h]] == native) return (uint8_t)g_pal.hash[h];
+        h = (h + 1) & (PALETTE_HASH - 1);
+    }
+    int idx = g_pal.count++;
+    g_pal.native[idx] = native;
+    g_pal.hash[h] = idx;
+    return (uint8_t)idx;
 }
 
-// Convert M8 RGB (8-8-8) to Native Format (16 or 32)
 static inline uint32_t pack_color(uint8_t r, uint8_t g, uint8_t b) {
-    if (g_fb.bpp == 4) {
-        // ARGB8888
-        return (0xFF << 24) | (r << 16) | (g << 8) | b;
-    } else {
-        // RGB565
-        return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+    uint32_t native = pack_native(r, g, b);
+    return (g_fb.rbpp == 1) ? palette_index(native) : native;
+}
+
+static inline uint8_t* render_ptr(int x, int y) {
+    return (uint8_t*)g_fb.render_buffer + (y * g_fb.stride) + (x * g_fb.rbpp);
+}
+
+// Expand render buffer pixels to native format. Returns the render buffer
+// itself when it already is native, else the expanded copy in 'out'.
+static inline const uint8_t* native_pixels(int x, int y, int n, uint8_t* out) {
+    const uint8_t* src = render_ptr(x, y);
+    if (g_fb.rbpp != 1) return src;
+    if (g_fb.bpp == 4) kern.expand32((uint32_t*)out, src, n, g_pal.native);
+    else kern.expand16((uint16_t*)out, src, n, g_pal.native);
+    return out;
+}
+
+static inline void fill_pixels(uint8_t* dst, uint32_t color, int n) {
+    switch (g_fb.rbpp) {
+    case 4: kern.fill32((uint32_t*)dst, color, n); break;
+    case 2: kern.fill16((uint16_t*)dst, (uint16_t)color, n); break;
+    default: kern.fill8(dst, (uint8_t)color, n); break;
     }
 }
 
+static inline void glyph_pixels(uint8_t* dst, uint32_t bits, int n, uint32_t fore, uint32_t back, bool opaque) {
+    switch (g_fb.rbpp) {
+    case 4: kern.glyph32((uint32_t*)dst, bits, n, fore, back, opaque); break;
+    case 2: kern.glyph16((uint16_t*)dst, bits, n, (uint16_t)fore, (uint16_t)back, opaque); break;
+    default: kern.glyph8(dst, bits, n, (uint8_t)fore, (uint8_t)back, opaque); break;
+    }
+}
+
+static inline void put_pixel(int x, int y, uint32_t color) {
+    uint8_t* p = render_ptr(x, y);
+    switch (g_fb.rbpp) {
+    case 4: *(uint32_t*)p = color; break;
+    case 2: *(uint16_t*)p = (uint16_t)color; break;
+    default: *p = (uint8_t)color; break;
+    }
+}
+
+// --- Optimization: Deferred Background Clears ---
+// Rects that cover whole tiles (full-screen clears above all) only record
+// the color of those tiles. The M8 usually repaints most of the screen right
+// after a clear, so opaque draws onto a pending tile just set their pixels in
+// a coverage bitmap; when the tile is resolved only the pixels nobody drew
+// get the color, and a fully covered tile costs nothing. Tiles are resolved
+// just before the blit, or before anything that needs the old pixels
+// (transparent glyphs, the waveform, palette scans).
+#define COVER_WORDS (M8_MAX_WIDTH / 32)
+
+static uint32_t pending_tiles[TILE_ROWS];
+static uint32_t pending_color[TILE_ROWS][TILE_COLS]; // Render buffer format
+static uint32_t cover_rows[M8_MAX_HEIGHT][COVER_WORDS];  // Bit = pixel drawn since its tile was deferred
+
+static inline uint32_t tile_span_mask(int tx0, int tx1) {
+    // Tiles [tx0, tx1), tx1 <= TILE_COLS < 32
+    return (1u << tx1) - (1u << tx0);
+}
+
+// Cover bits of tile 'tx' in one row, bit i = pixel i of the tile
+static inline uint32_t tile_cover(int tx, int y) {
+    return (cover_rows[y][tx >> 1] >> ((tx & 1) << TILE_SHIFT)) & 0xFFFF;
+}
+
+// Record 'color' for the tiles of rows [ty0, ty1) selected by 'mask'
+static void defer_tiles(int ty0, int ty1, uint32_t mask, uint32_t color) {
+    for (int ty = ty0; ty < ty1; ty++) {
+        for (uint32_t bits = mask; bits; bits &= bits - 1) {
+            int tx = __builtin_ctz(bits);
+            pending_color[ty][tx] = color;
+            uint32_t keep = ~(0xFFFFu << ((tx & 1) << TILE_SHIFT));
+            for (int y = ty << TILE_SHIFT; y < (ty + 1) << TILE_SHIFT; y++) cover_rows[y][tx >> 1] &= keep;
+        }
+        pending_tiles[ty] |= mask;
+        g_stats.tiles_deferred += __builtin_popcount(mask);
+    }
+}
+
+// Columns [x0, x1) of a 1-bit-per-pixel row: words w0..w1, edges masked
+typedef struct {
+    int w0, w1;
+    uint32_t m0, m1;
+} BitSpan;
+
+static inline BitSpan bit_span(int x0, int x1) {
+    BitSpan s = { x0 >> 5, (x1 - 1) >> 5, 0xFFFFFFFFu << (x0 & 31), 0xFFFFFFFFu >> (31 - ((x1 - 1) & 31)) };
+    if (s.w0 == s.w1) s.m0 &= s.m1;
+    return s;
+}
+
+static inline void bit_span_set(uint32_t* row, const BitSpan* s) {
+    row[s->w0] |= s->m0;
+    if (s->w1 == s->w0) return;
+    for (int k = s->w0 + 1; k < s->w1; k++) row[k] = 0xFFFFFFFFu;
+    row[s->w1] |= s->m1;
+}
+
+static inline bool bit_span_full(const uint32_t* row, const BitSpan* s) {
+    if ((row[s->w0] & s->m0) != s->m0) return false;
+    if (s->w1 == s->w0) return true;
+    for (int k = s->w0 + 1; k < s->w1; k++) {
+        if (row[k] != 0xFFFFFFFFu) return false;
+    }
+    return (row[s->w1] & s->m1) == s->m1;
+}
+
+// An opaque draw is about to write every pixel of a clipped rect
+static void cover_rect(int x, int y, int w, int h) {
+    uint32_t touched = tile_span_mask(x >> TILE_SHIFT, ((x + w - 1) >> TILE_SHIFT) + 1);
+    BitSpan span = bit_span(x, x + w);
+
+    for (int ty = y >> TILE_SHIFT; ty <= (y + h - 1) >> TILE_SHIFT; ty++) {
+        if (!(pending_tiles[ty] & touched)) continue;
+        int r0 = ty << TILE_SHIFT, r1 = r0 + TILE_SIZE;
+        if (r0 < y) r0 = y;
+        if (r1 > y + h) r1 = y + h;
+        for (int row = r0; row < r1; row++) bit_span_set(cover_rows[row], &span);
+    }
+}
+
+// Fill the pending tiles of tile row 'ty' selected by 'mask'. Untouched
+// neighbours waiting for the same color are filled as one run, partly
+// covered tiles only where nothing was drawn.
+static void resolve_tiles(int ty, uint32_t mask) {
+    uint32_t bits = pending_tiles[ty] & mask;
+    if (!bits) return;
+    pending_tiles[ty] &= ~bits;
+
+    int y0 = ty << TILE_SHIFT;
+    uint32_t clean = 0;
+    for (uint32_t b = bits; b; b &= b - 1) {
+        int tx = __builtin_ctz(b);
+        uint32_t any = 0, all = 0xFFFF;
+        for (int y = y0; y < y0 + TILE_SIZE; y++) {
+            uint32_t c = tile_cover(tx, y);
+            any |= c;
+            all &= c;
+        }
+        if (!any) {
+            clean |= 1u << tx;
+            continue;
+        }
+        if (all == 0xFFFF) continue; // Overdrawn, the clear is never needed
+        g_stats.tiles_filled++;
+        for (int y = y0; y < y0 + TILE_SIZE; y++) {
+            uint32_t hole = ~tile_cover(tx, y) & 0xFFFF;
+            while (hole) {
+                int c = __builtin_ctz(hole);
+                int n = __builtin_ctz(~(hole >> c));
+                fill_pixels(render_ptr((tx << TILE_SHIFT) + c, y), pending_color[ty][tx], n);
+                hole &= ~(((1u << n) - 1) << c);
+            }
+        }
+    }
+
+    g_stats.tiles_filled += __builtin_popcount(clean);
+    while (clean) {
+        int tx0 = __builtin_ctz(clean);
+        uint32_t color = pending_color[ty][tx0];
+        int tx1 = tx0 + 1;
+        while (tx1 < g_fb.tile_cols && (clean & (1u << tx1)) && pending_color[ty][tx1] == color) tx1++;
+        for (int y = y0; y < y0 + TILE_SIZE; y++) {
+            fill_pixels(render_ptr(tx0 << TILE_SHIFT, y), color, (tx1 - tx0) << TILE_SHIFT);
+        }
+        clean &= ~tile_span_mask(tx0, tx1);
+    }
+}
+
+// Resolve every tile a clipped render buffer rect touches
+static void resolve_rect(int x, int y, int w, int h) {
+    uint32_t mask = tile_span_mask(x >> TILE_SHIFT, ((x + w - 1) >> TILE_SHIFT) + 1);
+    for (int ty = y >> TILE_SHIFT; ty <= (y + h - 1) >> TILE_SHIFT; ty++) resolve_tiles(ty, mask);
+}
+
+static void resolve_all(void) {
+    for (int ty = 0; ty < g_fb.tile_rows; ty++) resolve_tiles(ty, ~0u);
+}
+
+#define FONT_SLOTS 5
+
+static const struct inline_font* const font_table[FONT_SLOTS] = {
+    &font_v1_small, &font_v1_large, &font_v2_small, &font_v2_large, &font_v2_huge
+};
+
+static inline int font_slot(int idx) {
+    return (idx >= 0 && idx < FONT_SLOTS - 1) ? idx : FONT_SLOTS - 1;
+}
+
 static const struct inline_font* get_font_ptr(int idx) {
-    if(idx == 0) return &font_v1_small;
-    if(idx == 1) return &font_v1_large;
-    if(idx == 2) return &font_v2_small;
-    if(idx == 3) return &font_v2_large;
-    return &font_v2_huge;
+    return font_table[font_slot(idx)];
+}
+
+// --- Optimization: Glyph Atlas ---
+// Each font's BMP is decoded once into one 16-bit mask per glyph row,
+// top-down, MSB = leftmost pixel. Drawing then expands whole rows through the
+// glyph kernels instead of re-parsing the BMP bit by bit.
+#define GLYPH_COUNT 94
+#define GLYPH_MAX_H 16
+
+typedef struct {
+    uint16_t rows[GLYPH_COUNT][GLYPH_MAX_H];
+} GlyphAtlas;
+
+static GlyphAtlas glyph_atlas[FONT_SLOTS];
+static bool glyph_atlas_ready[FONT_SLOTS];
+
+static void build_glyph_atlas(int slot) {
+    if (glyph_atlas_ready[slot]) return;
+    const struct inline_font* font = font_table[slot];
+    GlyphAtlas* atlas = &glyph_atlas[slot];
+
+    int32_t bmp_w = *(int32_t*)&font->image_data[18];
+    int32_t bmp_h = *(int32_t*)&font->image_data[22];
+    uint32_t data_offset = *(uint32_t*)&font->image_data[10];
+
+    int row_stride = ((bmp_w + 31) / 32) * 4;
+    int glyph_w = bmp_w / GLYPH_COUNT;
+    int rows = font->glyph_y < GLYPH_MAX_H ? font->glyph_y : GLYPH_MAX_H;
+
+    memset(atlas, 0, sizeof(*atlas));
+    for (int g = 0; g < GLYPH_COUNT; g++) {
+        for (int j = 0; j < rows && j < bmp_h; j++) {
+            // BMP rows are stored bottom-up
+            const uint8_t* bmp_row_data = &font->image_data[data_offset + ((bmp_h - 1 - j) * row_stride)];
+            uint16_t bits = 0;
+            for (int i = 0; i < font->glyph_x && i < 16; i++) {
+                int cur_x = g * glyph_w + i;
+                if ((bmp_row_data[cur_x >> 3] >> (7 - (cur_x & 7))) & 1) bits |= 0x8000 >> i;
+            }
+            atlas->rows[g][j] = bits;
+        }
+    }
+    glyph_atlas_ready[slot] = true;
 }
 
 // --- Public Interface ---
 
+// --- Optimization: Character Cell Model ---
+// The M8 UI is a text grid that resends the same characters constantly. Each
+// cell remembers the last character drawn there; an identical CMD_DRAW_CHAR
+// is then dropped before rasterisation and damage tracking. Cells are indexed
+// by the M8 coordinates divided by the glyph size and keep their exact origin,
+// so irregular positions simply miss. Anything else drawn over a cell
+// invalidates it.
+#define CELL_COLS (M8_MAX_WIDTH / 5 + 1)   // Smallest glyph is 5x7
+#define CELL_ROWS (M8_MAX_HEIGHT / 7 + 1)
+
+typedef struct {
+    int16_t x, y;        // M8 coordinates of the char, x = -1 when invalid
+    char c;
+    uint32_t fore, back; // Native colors
+} CharCell;
+
+static CharCell char_cells[CELL_ROWS][CELL_COLS];
+
+static void reset_cells(void) {
+    for (int r = 0; r < CELL_ROWS; r++)
+        for (int c = 0; c < CELL_COLS; c++) char_cells[r][c].x = -1;
+}
+
+// Invalidate every cell whose glyph overlaps the given render buffer rect
+static void invalidate_cells(int x, int y, int w, int h) {
+    const struct inline_font* font = get_font_ptr(current_font_idx);
+    int gw = font->glyph_x, gh = font->glyph_y;
+    // Cell origins are in M8 coordinates, glyphs are drawn shifted down
+    int y_off = font->text_offset_y + font->screen_offset_y;
+    y -= y_off;
+
+    int c0 = (x - gw + 1) / gw, c1 = (x + w - 1) / gw;
+    int r0 = (y - gh + 1) / gh, r1 = (y + h - 1) / gh;
+    if (c0 < 0) c0 = 0;
+    if (r0 < 0) r0 = 0;
+    if (c1 >= CELL_COLS) c1 = CELL_COLS - 1;
+    if (r1 >= CELL_ROWS) r1 = CELL_ROWS - 1;
+
+    for (int r = r0; r <= r1; r++) {
+        for (int c = c0; c <= c1; c++) {
+            CharCell* cell = &char_cells[r][c];
+            if (cell->x < 0) continue;
+            if (cell->x < x + w && cell->x + gw > x && cell->y < y + h && cell->y + gh > y) {
+                cell->x = -1;
+            }
+        }
+    }
+}
+
+// --- Optimization: Column-Span Waveform ---
+// Consecutive waveform samples are one column apart, so each Bresenham
+// segment covers a run of rows in its first column and the rest in the
+// second, and every column of the trace ends up as one vertical span. A new
+// trace then only erases the rows of the old span it no longer covers and
+// draws the rows it adds. Columns something else was drawn over since the
+// last trace are cleared in full first, as before.
+typedef struct {
+    int16_t lo, hi;  // Rows of the trace, lo > hi when the column is empty
+    uint32_t native; // Trace color, native so palette remaps cannot stale it
+    bool known;      // Rows 0..wave_max_h hold only background and this span
+} WaveColumn;
+
+static WaveColumn wave_cols[M8_MAX_WIDTH];
+static int wave_max_h = -1;
+
+// Bresenham from (0, 0) to (1, m) plots rows [0, first) in column 0 and
+// rows [second, m] in column 1
+static int16_t wave_split[256][2];
+
+static void init_wave_split(void) {
+    for (int m = 0; m < 256; m++) {
+        int x = 0, y = 0, err = 1 - m;
+        int first = 0, second = -1;
+        while (1) {
+            if (x == 0) first++;
+            else if (second < 0) second = y;
+            if (x == 1 && y == m) break;
+            int e2 = 2 * err;
+            if (e2 >= -m) { err -= m; x++; }
+            if (e2 <= 1) { err += 1; y++; }
+        }
+        wave_split[m][0] = first;
+        wave_split[m][1] = second;
+    }
+}
+
+// Something other than the waveform was drawn over columns [x, x + w)
+static void invalidate_wave(int x, int y, int w) {
+    if (y > wave_max_h) return;
+    for (int c = x; c < x + w; c++) wave_cols[c].known = false;
+}
+
+// The whole screen was just cleared to the background
+static void reset_wave(void) {
+    for (int c = 0; c < g_fb.width; c++) {
+        wave_cols[c].lo = 1;
+        wave_cols[c].hi = 0;
+        wave_cols[c].known = true;
+    }
+}
+
+// Rows [y0, y1] of column x, growing [*ylo, *yhi] by what was written
+static void fill_column(int x, int y0, int y1, uint32_t color, int* ylo, int* yhi) {
+    if (y0 > y1) return;
+    if (y0 < *ylo) *ylo = y0;
+    if (y1 > *yhi) *yhi = y1;
+
+    uint8_t* p = render_ptr(x, y0);
+    int stride = g_fb.stride;
+    switch (g_fb.rbpp) {
+    case 4: for (int y = y0; y <= y1; y++, p += stride) *(uint32_t*)p = color; break;
+    case 2: for (int y = y0; y <= y1; y++, p += stride) *(uint16_t*)p = (uint16_t)color; break;
+    default: for (int y = y0; y <= y1; y++, p += stride) *p = (uint8_t)color; break;
+    }
+}
+
+// Rows [y0, y1] of column x that are not in [skip_lo, skip_hi]
+static void fill_column_outside(int x, int y0, int y1, int skip_lo, int skip_hi, uint32_t color, int* ylo, int* yhi) {
+    if (skip_lo > skip_hi) {
+        fill_column(x, y0, y1, color, ylo, yhi);
+        return;
+    }
+    fill_column(x, y0, (skip_lo - 1 < y1) ? skip_lo - 1 : y1, color, ylo, yhi);
+    fill_column(x, (skip_hi + 1 > y0) ? skip_hi + 1 : y0, y1, color, ylo, yhi);
+}
+
+static inline void span_add(int16_t* lo, int16_t* hi, int a, int b) {
+    if (a > b) { int t = a; a = b; b = t; }
+    if (a < *lo) *lo = a;
+    if (b > *hi) *hi = b;
+}
+
+// Leave the indexed render buffer for good, see the overflow policy above
+static void palette_disable(void) {
+    resolve_all();
+    uint8_t* native = malloc(g_fb.width * g_fb.height * g_fb.bpp);
+    uint8_t* indexed = g_fb.render_buffer;
+    for (int y = 0; y < g_fb.height; y++) {
+        native_pixels(0, y, g_fb.width, native + (y * g_fb.native_stride));
+    }
+    g_fb.render_buffer = native;
+    g_fb.rbpp = g_fb.bpp;
+    g_fb.stride = g_fb.native_stride;
+    free(indexed);
+
+    global_bg_color = g_pal.native[global_bg_color];
+    reset_cells(); // They hold palette indices
+    printf("Display: more than %d colors on screen, leaving indexed mode\n", PALETTE_SIZE);
+}
+
+// Make room for 'n' new palette entries before any color is packed
+static void palette_reserve(int n) {
+    if (g_fb.rbpp != 1 || g_pal.count + n <= PALETTE_SIZE) return;
+    resolve_all();
+
+    // Reclaim indices no longer on screen, keeping the background color
+    bool used[PALETTE_SIZE] = { false };
+    const uint8_t* p = g_fb.render_buffer;
+    for (int i = 0; i < g_fb.width * g_fb.height; i++) used[p[i]] = true;
+    used[global_bg_color] = true;
+
+    uint8_t remap[PALETTE_SIZE] = { 0 };
+    int count = 0;
+    for (int i = 0; i < g_pal.count; i++) {
+        if (used[i]) remap[i] = count++;
+    }
+
+    if (count + n > PALETTE_SIZE) {
+        palette_disable();
+        return;
+    }
+
+    for (int i = 0; i < g_pal.count; i++) {
+        if (used[i]) g_pal.native[remap[i]] = g_pal.native[i];
+    }
+
+    uint8_t* q = g_fb.render_buffer;
+    for (int i = 0; i < g_fb.width * g_fb.height; i++) q[i] = remap[q[i]];
+    global_bg_color = remap[global_bg_color];
+    g_pal.count = count;
+    palette_rehash();
+    reset_cells(); // They hold palette indices
+}
+
+// Queued draws must be rasterised with the font they were sent with
+static void flush_commands(void);
+
 void display_set_font(int font_index) {
+    flush_commands();
     current_font_idx = font_index;
+    build_glyph_atlas(font_slot(font_index));
+    reset_cells();
 }
 
-void display_init(void) {
-    g_fb.fb_fd = open(app_config.fb_path, O_RDWR);
-    if (g_fb.fb_fd == -1) { 
-        fprintf(stderr, "Display Error: cannot open %s\n", app_config.fb_path); 
-        exit(1); 
+void display_set_blit_mode(BlitMode mode) {
+    if (mode < BLIT_COPY || mode >= BLIT_MODE_COUNT) {
+        printf("Display: unknown blit_mode %d, using copy\n", (int)mode);
+        mode = BLIT_COPY;
     }
+    // Nothing is copied, so nothing to diff
+    if (g_fb.direct && mode != BLIT_COPY) {
+        printf("Display: blit_mode %d needs a render buffer, direct_render=1 keeps copy\n", (int)mode);
+        mode = BLIT_COPY;
+    }
+    if (mode != BLIT_COPY && !g_fb.shadow_buffer) {
+        g_fb.shadow_buffer = malloc(g_fb.width * g_fb.height * g_fb.bpp * g_fb.pages);
+    }
+    // The shadow is not maintained while copying, so resync it with a full blit
+    if (mode != g_fb.blit_mode) {
+        g_fb.shadow_valid[0] = g_fb.shadow_valid[1] = false;
+        mark_all_dirty();
+    }
+    g_fb.blit_mode = mode;
+}
+
+BlitMode display_get_blit_mode(void) {
+    return g_fb.blit_mode;
+}
+
+static int pan_to_page(int page) {
+    if (g_fb.offscreen) return 0;
+    struct fb_var_screeninfo var = g_fb.vinfo;
+    var.xoffset = 0;
+    var.yoffset = page * g_fb.vinfo.yres;
+    return ioctl(g_fb.fb_fd, FBIOPAN_DISPLAY, &var);
+}
+
+// --- DRM Backend ---
+// [display] backend=drm scans out two XRGB8888 dumb buffers through KMS
+// instead of fbdev. They are set up to look like a two-page framebuffer, so
+// every blit path works unchanged; a flip is an atomic commit that carries
+// the output rectangles written by the blit as FB_DAMAGE_CLIPS.
+#define DAMAGE_MAX 64
+
+static DrmRect g_damage[DAMAGE_MAX];
+static int g_damage_count;
+
+// Record an output rectangle written by this blit (before centring offsets).
+// A rect continuing one with the same columns from the tile row above is
+// merged into it; past DAMAGE_MAX everything is folded into the last rect.
+static void add_damage(int x0, int y0, int x1, int y1) {
+    if (!g_fb.drm || x0 >= x1 || y0 >= y1) return;
+    x0 += g_fb.offset_x; x1 += g_fb.offset_x;
+    y0 += g_fb.offset_y; y1 += g_fb.offset_y;
+    if (x1 > (int)g_fb.vinfo.xres) x1 = g_fb.vinfo.xres;
+    if (y1 > (int)g_fb.vinfo.yres) y1 = g_fb.vinfo.yres;
+    if (x0 >= x1 || y0 >= y1) return;
 
+    for (int i = 0; i < g_damage_count; i++) {
+        DrmRect *d = &g_damage[i];
+        if (d->x1 == x0 && d->x2 == x1 && d->y2 == y0) {
+            d->y2 = y1;
+            return;
+        }
+    }
+    if (g_damage_count == DAMAGE_MAX) {
+        DrmRect *d = &g_damage[DAMAGE_MAX - 1];
+        if (x0 < d->x1) d->x1 = x0;
+        if (y0 < d->y1) d->y1 = y0;
+        if (x1 > d->x2) d->x2 = x1;
+        if (y1 > d->y2) d->y2 = y1;
+        return;
+    }
+    g_damage[g_damage_count++] = (DrmRect){ x0, y0, x1, y1 };
+}
+
+static bool init_drm(void) {
+    DrmOutput out;
+    if (drm_open(app_config.drm_path, app_config.video_mode, app_config.vsync_pacing, &out) == -1) {
+        printf("Display: DRM backend unavailable, using %s\n", app_config.fb_path);
+        return false;
+    }
+
+    g_fb.drm = true;
+    g_fb.fb_fd = -1;
+    memset(&g_fb.vinfo, 0, sizeof(g_fb.vinfo));
+    memset(&g_fb.finfo, 0, sizeof(g_fb.finfo));
+    g_fb.vinfo.xres = g_fb.vinfo.xres_virtual = out.width;
+    g_fb.vinfo.yres = out.height;
+    g_fb.vinfo.yres_virtual = 2 * out.height;
+    g_fb.vinfo.bits_per_pixel = out.bpp;
+    g_fb.vinfo.red = (struct fb_bitfield){ 16, 8, 0 };
+    g_fb.vinfo.green = (struct fb_bitfield){ 8, 8, 0 };
+    g_fb.vinfo.blue = (struct fb_bitfield){ 0, 8, 0 };
+    g_fb.finfo.line_length = out.pitch;
+    g_fb.fb_mem = out.pages[0];
+    g_fb.page_mem[0] = out.pages[0];
+    g_fb.page_mem[1] = out.pages[1];
+    g_fb.pages = 2;
+    g_fb.back_page = 1;
+    g_fb.vsync_paced = app_config.vsync_pacing;
+    return true;
+}
+
+// --- Optimization: Rotation in the Blit Path ---
+// [system] rotation writes the image to the framebuffer in the panel's
+// native orientation, so fbtft does not have to rotate. Each dirty 16x16
+// tile is rotated as one block (small enough to stay in cache) with the
+// transpose/reverse kernels. Both M8 dimensions are whole tiles, so a
+// source tile always lands on exactly one output tile.
+#define ROT_TILE_ROWS (TILE_COLS > TILE_ROWS ? TILE_COLS : TILE_ROWS)
+_Static_assert(320 % TILE_SIZE == 0 && 240 % TILE_SIZE == 0 && M8_MAX_WIDTH % TILE_SIZE == 0 &&
+               M8_MAX_HEIGHT % TILE_SIZE == 0, "rotation needs whole tiles");
+
+static void rotate_tile_pos(int tx, int ty, int* otx, int* oty) {
+    switch (g_fb.rotation) {
+    case 90:  *otx = g_fb.tile_rows - 1 - ty; *oty = tx; break;
+    case 270: *otx = ty; *oty = g_fb.tile_cols - 1 - tx; break;
+    default:  *otx = g_fb.tile_cols - 1 - tx; *oty = g_fb.tile_rows - 1 - ty; break;
+    }
+}
+
+static void unrotate_tile_pos(int otx, int oty, int* tx, int* ty) {
+    switch (g_fb.rotation) {
+    case 90:  *tx = oty; *ty = g_fb.tile_rows - 1 - otx; break;
+    case 270: *tx = g_fb.tile_cols - 1 - oty; *ty = otx; break;
+    default:  *tx = g_fb.tile_cols - 1 - otx; *ty = g_fb.tile_rows - 1 - oty; break;
+    }
+}
+
+// Rotate source tile (tx, ty) into an output image 'out' whose first row is
+// output row 'out_y0'. Strides are in pixels.
+static void rotate_tile(int tx, int ty, uint8_t* out, int out_stride, int out_y0) {
+    int bpp = g_fb.bpp;
+    int x0 = tx << TILE_SHIFT, y0 = ty << TILE_SHIFT;
+
+    const uint8_t* src = render_ptr(x0, y0);
+    int src_stride = g_fb.width;
+    if (g_fb.rbpp == 1) {
+        for (int j = 0; j < TILE_SIZE; j++) {
+            native_pixels(x0, y0 + j, TILE_SIZE, g_fb.rot_block + j * TILE_SIZE * bpp);
+        }
+        src = g_fb.rot_block;
+        src_stride = TILE_SIZE;
+    }
+
+    int otx, oty;
+    rotate_tile_pos(tx, ty, &otx, &oty);
+    uint8_t* dst = out + ((oty << TILE_SHIFT) - out_y0) * out_stride * bpp + (otx << TILE_SHIFT) * bpp;
+    const uint8_t* last_row = src + (TILE_SIZE - 1) * src_stride * bpp;
+    uint8_t* last_out = dst + (TILE_SIZE - 1) * out_stride * bpp;
+
+    switch (g_fb.rotation) {
+    case 90:
+        // Output rows are source columns, read from the bottom row up
+        if (bpp == 4) kern.transpose32((uint32_t*)dst, out_stride, (const uint32_t*)last_row, -src_stride, TILE_SIZE, TILE_SIZE);
+        else kern.transpose16((uint16_t*)dst, out_stride, (const uint16_t*)last_row, -src_stride, TILE_SIZE, TILE_SIZE);
+        break;
+    case 270:
+        // Output rows are source columns, written from the bottom row up
+        if (bpp == 4) kern.transpose32((uint32_t*)last_out, -out_stride, (const uint32_t*)src, src_stride, TILE_SIZE, TILE_SIZE);
+        else kern.transpose16((uint16_t*)last_out, -out_stride, (const uint16_t*)src, src_stride, TILE_SIZE, TILE_SIZE);
+        break;
+    default:
+        for (int j = 0; j < TILE_SIZE; j++) {
+            uint8_t* d = last_out - j * out_stride * bpp;
+            const uint8_t* s = src + j * src_stride * bpp;
+            if (bpp == 4) kern.reverse32((uint32_t*)d, (const uint32_t*)s, TILE_SIZE);
+            else kern.reverse16((uint16_t*)d, (const uint16_t*)s, TILE_SIZE);
+        }
+        break;
+    }
+}
+
+static void init_rotation(void) {
+    g_fb.rotation = 0;
+    int rot = app_config.rotation;
+    if (rot == 0) return;
+    if (rot != 90 && rot != 180 && rot != 270) {
+        fprintf(stderr, "Display: rotation must be 0, 90, 180 or 270, ignoring %d\n", rot);
+        return;
+    }
+
+    int out_w = (rot == 180) ? g_fb.width : g_fb.height;
+    int out_h = (rot == 180) ? g_fb.height : g_fb.width;
+    if (out_w > (int)g_fb.vinfo.xres || out_h > (int)g_fb.vinfo.yres) {
+        fprintf(stderr, "Display: rotated %dx%d image does not fit %ux%u, ignoring rotation\n",
+                out_w, out_h, g_fb.vinfo.xres, g_fb.vinfo.yres);
+        return;
+    }
+
+    g_fb.rotation = rot;
+    g_fb.out_w = out_w;
+    g_fb.out_h = out_h;
+    g_fb.offset_x = (g_fb.vinfo.xres - out_w) / 2;
+    g_fb.offset_y = (g_fb.vinfo.yres - out_h) / 2;
+    g_fb.rot_strip = malloc(out_w * TILE_SIZE * g_fb.bpp);
+    g_fb.rot_block = malloc(TILE_SIZE * TILE_SIZE * g_fb.bpp);
+    printf("Display: rotating %d degrees in the blit path\n", rot);
+}
+
+// --- Optimization: Scaled Output (HDMI) ---
+// On large screens the M8 image is stretched instead of centred 1:1:
+// by an integer factor (every pixel repeated k times) or best-fit nearest
+// neighbour through a column map. Only the scaled image of the damaged tiles
+// is written, and each scaled span is built once per source row and then
+// copied to all the output rows that repeat it.
+static int* col_map;   // Output column -> source column (best-fit only)
+static int* col_start; // Source column -> first output column, width + 1 entries
+static int* row_start; // Source row -> first output row, height + 1 entries
+
+static void init_scaling(void) {
+    g_fb.scaled = false;
+    const char* mode = app_config.scale;
+    int xres = g_fb.vinfo.xres, yres = g_fb.vinfo.yres;
+    int fit_k = (xres / g_fb.width < yres / g_fb.height) ? xres / g_fb.width : yres / g_fb.height;
+
+    int out_w, out_h;
+    if (strcmp(mode, "fit") == 0) {
+        // Largest size with the same aspect ratio
+        if (xres * g_fb.height <= yres * g_fb.width) {
+            out_w = xres;
+            out_h = xres * g_fb.height / g_fb.width;
+        } else {
+            out_w = yres * g_fb.width / g_fb.height;
+            out_h = yres;
+        }
+    } else {
+        int k = (strcmp(mode, "int") == 0) ? fit_k : atoi(mode);
+        if (k > fit_k) {
+            printf("Display: %dx scale does not fit %dx%d, using %dx\n", k, xres, yres, fit_k);
+            k = fit_k;
+        }
+        out_w = k * g_fb.width;
+        out_h = k * g_fb.height;
+    }
+    // No downscaling, small screens keep the centred (or cropped) 1:1 image
+    if (out_w < g_fb.width || out_h < g_fb.height || (out_w == g_fb.width && out_h == g_fb.height)) return;
+
+    g_fb.scaled = true;
+    g_fb.out_w = out_w;
+    g_fb.out_h = out_h;
+    g_fb.scale_k = (out_w % g_fb.width == 0 && out_h == (out_w / g_fb.width) * g_fb.height) ? out_w / g_fb.width : 0;
+    g_fb.offset_x = (xres - out_w) / 2;
+    g_fb.offset_y = (yres - out_h) / 2;
+    g_fb.scale_line = malloc(out_w * g_fb.bpp);
+
+    // Output pixel o shows source pixel floor(o * M8 / out), so the first
+    // output pixel of source pixel s is ceil(s * out / M8).
+    col_map = malloc(out_w * sizeof(int));
+    col_start = malloc((g_fb.width + 1) * sizeof(int));
+    row_start = malloc((g_fb.height + 1) * sizeof(int));
+    for (int x = 0; x < out_w; x++) col_map[x] = x * g_fb.width / out_w;
+    for (int x = 0; x <= g_fb.width; x++) col_start[x] = (x * out_w + g_fb.width - 1) / g_fb.width;
+    for (int y = 0; y <= g_fb.height; y++) row_start[y] = (y * out_h + g_fb.height - 1) / g_fb.height;
+
+    if (g_fb.scale_k) printf("Display: %dx integer scaling to %dx%d\n", g_fb.scale_k, out_w, out_h);
+    else printf("Display: best-fit scaling to %dx%d\n", out_w, out_h);
+}
+
+// Switch the framebuffer to a native low resolution (e.g. "640x480") so
+// the scaler has less to write. The original mode is restored on close.
+static void set_video_mode(const char* mode) {
+    int w, h;
+    if (!*mode || sscanf(mode, "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0) return;
+
+    struct fb_var_screeninfo var = g_fb.vinfo;
+    var.xres = var.xres_virtual = w;
+    var.yres = h;
+    var.yres_virtual = app_config.page_flip ? 2 * h : h;
+    var.xoffset = var.yoffset = 0;
+    if (ioctl(g_fb.fb_fd, FBIOPUT_VSCREENINFO, &var) == -1) {
+        fprintf(stderr, "Display: cannot set video mode %s, keeping %ux%u\n", mode, g_fb.vinfo.xres, g_fb.vinfo.yres);
+        return;
+    }
+    g_fb.saved_vinfo = g_fb.vinfo;
+    g_fb.mode_changed = true;
     if (ioctl(g_fb.fb_fd, FBIOGET_FSCREENINFO, &g_fb.finfo) == -1) exit(2);
     if (ioctl(g_fb.fb_fd, FBIOGET_VSCREENINFO, &g_fb.vinfo) == -1) exit(3);
+    printf("Display: video mode %ux%u\n", g_fb.vinfo.xres, g_fb.vinfo.yres);
+}
+
+// Use the second half of a virtual framebuffer as a back page when possible
+static void init_page_flip(void) {
+    g_fb.pages = 1;
+    g_fb.back_page = 0;
+    if (!app_config.page_flip) return;
+
+    if (g_fb.vinfo.yres_virtual < 2 * g_fb.vinfo.yres) {
+        printf("Display: page flip unavailable (yres_virtual %u < 2 x %u), using single buffer\n",
+               g_fb.vinfo.yres_virtual, g_fb.vinfo.yres);
+        return;
+    }
+    if (pan_to_page(0) == -1) {
+        printf("Display: FBIOPAN_DISPLAY not supported, using single buffer\n");
+        return;
+    }
+    g_fb.pages = 2;
+    g_fb.back_page = 1;
+    printf("Display: page flipping enabled\n");
+}
+
+// --- Optimization: Direct Rendering ---
+// fbtft keeps the framebuffer in plain system RAM and its deferred IO pushes
+// whatever pages were written to the panel, so a separate render buffer only
+// costs a copy per frame and its memory. In direct mode the render buffer is
+// the framebuffer itself at the centring offset, with line_length as stride.
+// Damage is still tracked; the blit then has nothing left to copy and only
+// accounts for the written spans.
+static const char* direct_render_blocker(void) {
+    if (g_fb.drm) return "DRM backend";
+    if (g_fb.rbpp != g_fb.bpp) return "indexed=1";
+    if (g_fb.fbpp != g_fb.bpp) return "24 bpp";
+    if (g_fb.pages > 1) return "page_flip=1";
+    if (g_fb.rotation) return "rotation";
+    if (g_fb.scaled) return "scaling";
+    if ((int)g_fb.vinfo.xres < g_fb.width || (int)g_fb.vinfo.yres < g_fb.height) return "screen smaller than the M8's";
+    return NULL;
+}
+
+static void init_render_buffer(void) {
+    // auto: fbtft drivers name their framebuffer "fb_<chip>". It steps aside
+    // when a diff blit mode is configured: the page-aware diff keeps deferred
+    // IO from flushing unchanged pages, which saves far more SPI traffic than
+    // direct rendering saves in copies. direct_render=1 wins over blit_mode.
+    const char* want = app_config.direct_render;
+    bool direct = (strcmp(want, "1") == 0) ||
+                  (strcmp(want, "auto") == 0 && strncmp(g_fb.finfo.id, "fb_", 3) == 0);
+    if (direct && strcmp(want, "auto") == 0 && app_config.blit_mode != BLIT_COPY) {
+        printf("Display: blit_mode=%d diffs against a render buffer, not rendering directly\n", app_config.blit_mode);
+        direct = false;
+    }
+    const char* blocker = direct ? direct_render_blocker() : NULL;
+    if (blocker) {
+        if (strcmp(want, "1") == 0) printf("Display: direct rendering unavailable (%s), using a render buffer\n", blocker);
+        direct = false;
+    }
 
-    // Detect pixel depth
-    g_fb.bpp = g_fb.vinfo.bits_per_pixel / 8;
-    if (g_fb.bpp != 2 && g_fb.bpp != 4) {
-        // Fallback for uncommon depths (e.g. 24bit), treat as 32 for buffer allocation
-        g_fb.bpp = 4; 
+    g_fb.direct = direct;
+    if (direct) {
+        g_fb.stride = g_fb.finfo.line_length;
+        g_fb.render_buffer = (uint8_t*)g_fb.fb_mem + (g_fb.offset_y * g_fb.stride) + (g_fb.offset_x * g_fb.bpp);
+        for (int y = 0; y < g_fb.height; y++) memset(render_ptr(0, y), 0, g_fb.width * g_fb.bpp);
+        printf("Display: rendering directly into the framebuffer\n");
+        return;
     }
-    g_fb.stride = M8_WIDTH * g_fb.bpp;
 
-    long screensize = g_fb.vinfo.yres_virtual * g_fb.finfo.line_length;
-    g_fb.fb_mem = mmap(0, screensize, PROT_READ | PROT_WRITE, MAP_SHARED, g_fb.fb_fd, 0);
-    if (g_fb.fb_mem == MAP_FAILED) exit(4);
+    // Allocate buffer in NATIVE size, or one byte per pixel when indexed
+    g_fb.render_buffer = malloc(g_fb.width * g_fb.height * g_fb.rbpp);
+    memset(g_fb.render_buffer, 0, g_fb.width * g_fb.height * g_fb.rbpp);
+}
 
-    // Allocate buffer in NATIVE size
-    g_fb.render_buffer = malloc(M8_WIDTH * M8_HEIGHT * g_fb.bpp);
-    memset(g_fb.render_buffer, 0, M8_WIDTH * M8_HEIGHT * g_fb.bpp);
+// --- M8 Screen Geometry ---
+// Model:02 has a 480x320 screen, the older models 320x240. Everything sized
+// by it is set up here, at init for 320x240 and again when the system info
+// packet reports a Model:02. Static tables are sized for the largest screen,
+// so switching only reallocates the pixel buffers.
+static void init_geometry(int width, int height) {
+    g_fb.width = width;
+    g_fb.height = height;
+    g_fb.tile_cols = (width + TILE_SIZE - 1) / TILE_SIZE;
+    g_fb.tile_rows = (height + TILE_SIZE - 1) / TILE_SIZE;
+    g_fb.native_stride = width * g_fb.bpp;
+    g_fb.stride = width * g_fb.rbpp;
 
-    g_fb.offset_x = (g_fb.vinfo.xres - M8_WIDTH) / 2;
-    g_fb.offset_y = (g_fb.vinfo.yres - M8_HEIGHT) / 2;
+    g_fb.offset_x = ((int)g_fb.vinfo.xres - width) / 2;
+    g_fb.offset_y = ((int)g_fb.vinfo.yres - height) / 2;
     if(g_fb.offset_x < 0) g_fb.offset_x = 0;
     if(g_fb.offset_y < 0) g_fb.offset_y = 0;
-    
-    // Set default black in native format
+    init_rotation();
+    if (!g_fb.rotation) init_scaling();
+
+    init_render_buffer();
+    g_fb.line_buffer = malloc(g_fb.native_stride);
+    if (g_fb.blit_mode != BLIT_COPY) g_fb.shadow_buffer = malloc(width * height * g_fb.bpp * g_fb.pages);
+    g_fb.shadow_valid[0] = g_fb.shadow_valid[1] = false;
+
+    // Set default black in native format (index 0 when indexed, matching the
+    // zeroed render buffer)
+    palette_reset();
     global_bg_color = pack_color(0, 0, 0);
+    prev_waveform_size = 0;
+    memset(wave_cols, 0, sizeof(wave_cols));
+    memset(pending_tiles, 0, sizeof(pending_tiles));
+    reset_cells();
+
+    // Force full redraw (of both pages when flipping)
+    clear_dirty();
+    mark_all_dirty();
+    memcpy(prev_tiles, dirty_tiles, sizeof(prev_tiles));
+}
 
-    // Force full redraw on init
-    dirty_min_x = 0;
-    dirty_min_y = 0;
-    dirty_max_x = M8_WIDTH;
-    dirty_max_y = M8_HEIGHT;
+static void free_geometry(void) {
+    if (g_fb.render_buffer && !g_fb.direct) free(g_fb.render_buffer);
+    if (g_fb.shadow_buffer) free(g_fb.shadow_buffer);
+    if (g_fb.line_buffer) free(g_fb.line_buffer);
+    if (g_fb.scale_line) free(g_fb.scale_line);
+    if (g_fb.rot_strip) free(g_fb.rot_strip);
+    if (g_fb.rot_block) free(g_fb.rot_block);
+    if (col_map) free(col_map);
+    if (col_start) free(col_start);
+    if (row_start) free(row_start);
+    g_fb.render_buffer = g_fb.shadow_buffer = NULL;
+    g_fb.line_buffer = g_fb.scale_line = g_fb.rot_strip = g_fb.rot_block = NULL;
+    col_map = col_start = row_start = NULL;
+}
+
+void display_set_geometry(int width, int height) {
+    if (width == g_fb.width && height == g_fb.height) return;
+    if (width <= 0 || height <= 0 || width > M8_MAX_WIDTH || height > M8_MAX_HEIGHT) return;
+
+    flush_commands();
+    free_geometry();
+    // The old image may stick out of the new one
+    for (int p = 0; p < g_fb.pages; p++) memset(g_fb.page_mem[p], 0, (size_t)g_fb.vinfo.yres * g_fb.finfo.line_length);
+    init_geometry(width, height);
+    printf("Display: M8 screen is %dx%d\n", width, height);
+}
+
+void display_init(void) {
+    g_fb.drm = false;
+    if (strcmp(app_config.backend, "drm") == 0) init_drm();
+
+    g_fb.offscreen = (strcmp(app_config.backend, "offscreen") == 0);
+    if (g_fb.offscreen) {
+        g_fb.fb_fd = offscreen_open(app_config.offscreen_path, app_config.video_mode, app_config.offscreen_bpp,
+                                    app_config.offscreen_line_length, app_config.page_flip, &g_fb.vinfo, &g_fb.finfo);
+        if (g_fb.fb_fd == -1) exit(1);
+    } else if (!g_fb.drm) {
+        g_fb.fb_fd = open(app_config.fb_path, O_RDWR);
+        if (g_fb.fb_fd == -1) { 
+            fprintf(stderr, "Display Error: cannot open %s\n", app_config.fb_path); 
+            exit(1); 
+        }
+
+        if (ioctl(g_fb.fb_fd, FBIOGET_FSCREENINFO, &g_fb.finfo) == -1) exit(2);
+        if (ioctl(g_fb.fb_fd, FBIOGET_VSCREENINFO, &g_fb.vinfo) == -1) exit(3);
+        set_video_mode(app_config.video_mode);
+    }
+
+    init_pixel_format();
+    g_fb.rbpp = app_config.indexed ? 1 : g_fb.bpp;
+
+    if (!g_fb.drm) {
+        long screensize = g_fb.vinfo.yres_virtual * g_fb.finfo.line_length;
+        g_fb.fb_mem = mmap(0, screensize, PROT_READ | PROT_WRITE, MAP_SHARED, g_fb.fb_fd, 0);
+        if (g_fb.fb_mem == MAP_FAILED) exit(4);
+
+        init_page_flip();
+        g_fb.page_mem[0] = g_fb.fb_mem;
+        g_fb.page_mem[1] = (uint8_t*)g_fb.fb_mem + (size_t)g_fb.vinfo.yres * g_fb.finfo.line_length;
+
+        g_fb.vsync_paced = false;
+        if (app_config.vsync_pacing) {
+            g_fb.vsync_paced = (vsync_start(g_fb.fb_fd, app_config.vsync_hz) != -1);
+        }
+    }
+    g_fb.page_shift = __builtin_ctzl(sysconf(_SC_PAGESIZE));
+
+    kernels_init(app_config.kernels);
+
+    // Until the M8 reports its model
+    init_geometry(320, 240);
+    display_set_blit_mode(app_config.blit_mode);
+
+    build_glyph_atlas(font_slot(current_font_idx));
+    init_wave_split();
     
     printf("\033[?25l"); // Hide cursor
     fflush(stdout);
 }
 
 void display_close(void) {
-    if (g_fb.render_buffer) free(g_fb.render_buffer);
+    free_geometry();
+    vsync_stop();
+    if (g_fb.drm) drm_close();
+    else if (g_fb.pages > 1) pan_to_page(0);
+    if (g_fb.mode_changed) ioctl(g_fb.fb_fd, FBIOPUT_VSCREENINFO, &g_fb.saved_vinfo);
     if (g_fb.fb_fd != -1) close(g_fb.fb_fd);
     printf("\033[?25h"); // Show cursor
 }
 
+// Per-blit accounting. Spans are written in ascending framebuffer address
+// order, so a page only needs counting when it differs from the last one.
+// Pages are counted from the start of the mapping being written: fb_mem on
+// fbdev, where both pages share one mmap, but its own dumb buffer on DRM.
+typedef struct {
+    uint32_t bytes;
+    uint32_t skipped;
+    uint32_t pages;
+    long last_page;
+    const uint8_t *map;
+} BlitFrame;
+
+static inline void count_pages(BlitFrame *f, const uint8_t *dst, int size) {
+    long first = (long)((dst - f->map) >> g_fb.page_shift);
+    long last = (long)((dst + size - 1 - f->map) >> g_fb.page_shift);
+    f->pages += last - first + (first != f->last_page);
+    f->last_page = last;
+}
+
+// Blit spans are sized in working pixels, 'dst' points into the framebuffer.
+// Sizes are the same unless 24 bpp output is narrowed on the way.
+static inline int fb_bytes(int size) {
+    return (g_fb.fbpp == g_fb.bpp) ? size : size / g_fb.bpp * g_fb.fbpp;
+}
+
+static inline void blit_span_copy(BlitFrame *f, uint8_t *dst, const uint8_t *src, int size) {
+    int out = fb_bytes(size);
+    if (out == size) kern.copy_row(dst, src, size);
+    else kern.pack24(dst, (const uint32_t*)src, size / 4);
+    f->bytes += out;
+    count_pages(f, dst, out);
+}
+
+static inline void blit_span_diff(BlitFrame *f, uint8_t *dst, const uint8_t *src, uint8_t *shadow, int size) {
+    if (memcmp(src, shadow, size) == 0) {
+        f->skipped += fb_bytes(size);
+        return;
+    }
+    memcpy(shadow, src, size);
+    blit_span_copy(f, dst, src, size);
+}
+
+// BLIT_PAGES: split the span at framebuffer page boundaries and trim every
+// piece to its changed bytes, so deferred-IO drivers (fbtft) only see writes
+// to pages whose contents actually differ. Narrowed (24 bpp) output is split
+// and trimmed at whole pixels instead.
+static inline void blit_span_pages(BlitFrame *f, uint8_t *dst, const uint8_t *src, uint8_t *shadow, int size) {
+    int page_size = 1 << g_fb.page_shift;
+    int unit = (g_fb.fbpp == g_fb.bpp) ? 1 : g_fb.bpp;
+    int pos = 0;
+    while (pos < size) {
+        int in_page = page_size - (int)((dst + fb_bytes(pos) - f->map) & (page_size - 1));
+        if (unit > 1) in_page = (in_page + g_fb.fbpp - 1) / g_fb.fbpp * unit;
+        int end = pos + in_page;
+        if (end > size) end = size;
+
+        if (memcmp(src + pos, shadow + pos, end - pos) == 0) {
+            f->skipped += fb_bytes(end - pos);
+            pos = end;
+            continue;
+        }
+
+        int a = pos, b = end;
+        while (a < b && src[a] == shadow[a]) a++;
+        while (b > a && src[b - 1] == shadow[b - 1]) b--;
+        a -= a % unit;
+        b += (unit - b % unit) % unit;
+        f->skipped += fb_bytes((end - pos) - (b - a));
+        if (a < b) {
+            memcpy(shadow + a, src + a, b - a);
+            blit_span_copy(f, dst + fb_bytes(a), src + a, b - a);
+        }
+        pos = end;
+    }
+}
+
+// Scaled output: source pixels [x, x + n) of one row in native format are
+// trimmed to what changed (diff modes), scaled into scale_line and returned
+// as an output span. Returns false if nothing changed. Skipped bytes are
+// counted at output size, 'rows' being the output rows of this source row.
+typedef struct {
+    int x;
+    int w;
+} OutSpan;
+
+static inline bool scale_span(BlitFrame *f, BlitMode mode, const uint8_t *src, uint8_t *shadow, int x, int n, int rows, OutSpan *out) {
+    int bpp = g_fb.bpp;
+    if (mode != BLIT_COPY) {
+        int size = n * bpp;
+        int a = 0, b = size;
+        while (a < b && src[a] == shadow[a]) a++;
+        while (b > a && src[b - 1] == shadow[b - 1]) b--;
+        a /= bpp;
+        b = (b + bpp - 1) / bpp;
+        f->skipped += (uint32_t)((col_start[x + n] - col_start[x]) - (col_start[x + b] - col_start[x + a])) * g_fb.fbpp * rows;
+        if (a >= b) return false;
+        memcpy(shadow + a * bpp, src + a * bpp, (b - a) * bpp);
+        src += a * bpp;
+        x += a;
+        n = b - a;
+    }
+
+    out->x = col_start[x];
+    out->w = col_start[x + n] - out->x;
+    uint8_t *line = g_fb.scale_line + out->x * bpp;
+    if (g_fb.scale_k) {
+        if (bpp == 4) kern.scale32((uint32_t*)line, (const uint32_t*)src, n, g_fb.scale_k);
+        else kern.scale16((uint16_t*)line, (const uint16_t*)src, n, g_fb.scale_k);
+    } else {
+        // The column map holds absolute source columns
+        const uint8_t *row = src - x * bpp;
+        if (bpp == 4) kern.remap32((uint32_t*)line, (const uint32_t*)row, col_map + out->x, out->w);
+        else kern.remap16((uint16_t*)line, (const uint16_t*)row, col_map + out->x, out->w);
+    }
+    return true;
+}
+
+static inline void blit_span(BlitFrame *f, BlitMode mode, uint8_t *dst, const uint8_t *src, uint8_t *shadow, int size) {
+    if (mode == BLIT_PAGES) {
+        blit_span_pages(f, dst, src, shadow, size);
+    } else if (mode == BLIT_DIFF) {
+        blit_span_diff(f, dst, src, shadow, size);
+    } else {
+        blit_span_copy(f, dst, src, size);
+    }
+}
+
+// Merge adjacent dirty tiles of one tile row into runs of [start, end) pixels
+static inline int tile_runs(uint32_t bits, int width, int *run_start, int *run_size) {
+    int runs = 0;
+    while (bits) {
+        int tx = __builtin_ctz(bits);
+        int len = __builtin_ctz(~(bits >> tx));
+        int x0 = tx << TILE_SHIFT;
+        int x1 = (tx + len) << TILE_SHIFT;
+        if (x1 > width) x1 = width;
+        run_start[runs] = x0;
+        run_size[runs] = x1 - x0;
+        runs++;
+        bits &= ~((0xFFFFFFFFu >> (32 - len)) << tx);
+    }
+    return runs;
+}
+
+static void blit_tiles(BlitFrame *f, BlitMode mode, uint8_t *dst_base, uint8_t *shadow_base, bool flip) {
+    int fb_stride = g_fb.finfo.line_length;
+    int dst_x_offset_bytes = (g_fb.offset_x * g_fb.fbpp);
+
+    // A 480x320 image on a narrower screen is cropped at the right
+    int vis_w = g_fb.width;
+    if (!g_fb.scaled && g_fb.offset_x + vis_w > (int)g_fb.vinfo.xres) vis_w = g_fb.vinfo.xres - g_fb.offset_x;
+    uint32_t vis_mask = tile_span_mask(0, (vis_w + TILE_SIZE - 1) >> TILE_SHIFT);
+
+    for (int ty = 0; ty < g_fb.tile_rows; ty++) {
+        // The back page was last drawn two blits ago, so it also needs the
+        // damage of the previous blit.
+        uint32_t bits = (dirty_tiles[ty] | (flip ? prev_tiles[ty] : 0)) & vis_mask;
+        if (!bits) continue;
+
+        int run_start[TILE_COLS], run_size[TILE_COLS];
+        int runs = tile_runs(bits, vis_w, run_start, run_size);
+
+        int y_end = (ty + 1) << TILE_SHIFT;
+        if (y_end > g_fb.height) y_end = g_fb.height;
+
+        for (int r = 0; r < runs; r++) {
+            int x0 = run_start[r], x1 = run_start[r] + run_size[r];
+            if (g_fb.scaled) {
+                add_damage(col_start[x0], row_start[ty << TILE_SHIFT], col_start[x1], row_start[y_end]);
+            } else {
+                int y1 = y_end;
+                if (y1 + g_fb.offset_y > (int)g_fb.vinfo.yres) y1 = g_fb.vinfo.yres - g_fb.offset_y;
+                add_damage(x0, ty << TILE_SHIFT, x1, y1);
+            }
+        }
+
+        // OPTIMIZATION: Render buffer is native format -> simple memcpy.
+        // Indexed buffers are expanded one run at a time into the line buffer.
+        // Rows outer, runs inner so writes land in ascending address order.
+        for (int y = ty << TILE_SHIFT; y < y_end; y++) {
+            if (g_fb.scaled) {
+                // Scale every run once, then repeat them on each output row
+                uint8_t* shadow_row = shadow_base + (y * g_fb.native_stride);
+                int rows = row_start[y + 1] - row_start[y];
+                OutSpan spans[TILE_COLS];
+                int n_spans = 0;
+                for (int r = 0; r < runs; r++) {
+                    int o = run_start[r] * g_fb.bpp;
+                    const uint8_t* src = native_pixels(run_start[r], y, run_size[r], g_fb.line_buffer + o);
+                    n_spans += scale_span(f, mode, src, shadow_row + o, run_start[r], run_size[r], rows, &spans[n_spans]);
+                }
+                for (int oy = row_start[y]; oy < row_start[y + 1]; oy++) {
+                    uint8_t* dst_row = dst_base + ((oy + g_fb.offset_y) * fb_stride) + dst_x_offset_bytes;
+                    for (int s = 0; s < n_spans; s++) {
+                        int o = spans[s].x * g_fb.bpp;
+                        blit_span_copy(f, dst_row + spans[s].x * g_fb.fbpp, g_fb.scale_line + o, spans[s].w * g_fb.bpp);
+                    }
+                }
+                continue;
+            }
+            if ((y + g_fb.offset_y) >= g_fb.vinfo.yres) break;
+
+            uint8_t* shadow_row = shadow_base + (y * g_fb.native_stride);
+            uint8_t* dst_row = dst_base + 
+                               ((y + g_fb.offset_y) * fb_stride) + 
+                               dst_x_offset_bytes;
+
+            for (int r = 0; r < runs; r++) {
+                int o = run_start[r] * g_fb.bpp;
+                int size = run_size[r] * g_fb.bpp;
+                const uint8_t* src = native_pixels(run_start[r], y, run_size[r], g_fb.line_buffer + o);
+                blit_span(f, mode, dst_row + run_start[r] * g_fb.fbpp, src, shadow_row + o, size);
+            }
+        }
+    }
+}
+
+// Direct rendering: the pixels are already in place, only account for them
+static void count_direct(BlitFrame *f) {
+    for (int ty = 0; ty < g_fb.tile_rows; ty++) {
+        if (!dirty_tiles[ty]) continue;
+        int run_start[TILE_COLS], run_size[TILE_COLS];
+        int runs = tile_runs(dirty_tiles[ty], g_fb.width, run_start, run_size);
+        int y_end = (ty + 1) << TILE_SHIFT;
+        if (y_end > g_fb.height) y_end = g_fb.height;
+        for (int y = ty << TILE_SHIFT; y < y_end; y++) {
+            for (int r = 0; r < runs; r++) {
+                int size = run_size[r] * g_fb.bpp;
+                f->bytes += size;
+                count_pages(f, render_ptr(run_start[r], y), size);
+            }
+        }
+    }
+}
+
+// Rotated output: dirty source tiles are mapped to output tiles, then each
+// output tile row is rotated into the strip and written row by row, so the
+// framebuffer still sees ascending addresses. The shadow is kept in output
+// orientation (out_w x out_h).
+static void blit_rotated(BlitFrame *f, BlitMode mode, uint8_t *dst_base, uint8_t *shadow_base, bool flip) {
+    int bpp = g_fb.bpp;
+    int fb_stride = g_fb.finfo.line_length;
+    int out_stride = g_fb.out_w * bpp;
+    int out_rows = g_fb.out_h >> TILE_SHIFT;
+
+    uint32_t out_tiles[ROT_TILE_ROWS] = { 0 };
+    for (int ty = 0; ty < g_fb.tile_rows; ty++) {
+        uint32_t bits = dirty_tiles[ty] | (flip ? prev_tiles[ty] : 0);
+        while (bits) {
+            int tx = __builtin_ctz(bits);
+            int otx, oty;
+            rotate_tile_pos(tx, ty, &otx, &oty);
+            out_tiles[oty] |= 1u << otx;
+            bits &= bits - 1;
+        }
+    }
+
+    for (int oty = 0; oty < out_rows; oty++) {
+        uint32_t bits = out_tiles[oty];
+        if (!bits) continue;
+
+        int run_start[ROT_TILE_ROWS], run_size[ROT_TILE_ROWS];
+        int runs = tile_runs(bits, g_fb.out_w, run_start, run_size);
+        for (int k = 0; k < runs; k++) {
+            add_damage(run_start[k], oty << TILE_SHIFT, run_start[k] + run_size[k], (oty + 1) << TILE_SHIFT);
+        }
+
+        while (bits) {
+            int otx = __builtin_ctz(bits);
+            int tx, ty;
+            unrotate_tile_pos(otx, oty, &tx, &ty);
+            rotate_tile(tx, ty, g_fb.rot_strip, g_fb.out_w, oty << TILE_SHIFT);
+            bits &= bits - 1;
+        }
+
+        for (int r = 0; r < TILE_SIZE; r++) {
+            int oy = (oty << TILE_SHIFT) + r;
+            const uint8_t* strip_row = g_fb.rot_strip + r * out_stride;
+            uint8_t* shadow_row = shadow_base + oy * out_stride;
+            uint8_t* dst_row = dst_base + ((oy + g_fb.offset_y) * fb_stride) + (g_fb.offset_x * g_fb.fbpp);
+            for (int k = 0; k < runs; k++) {
+                int o = run_start[k] * bpp;
+                blit_span(f, mode, dst_row + run_start[k] * g_fb.fbpp, strip_row + o, shadow_row + o, run_size[k] * bpp);
+            }
+        }
+    }
+}
+
 void display_blit(void) {
+    flush_commands();
     if (dirty_min_x >= dirty_max_x || dirty_min_y >= dirty_max_y) return;
+    resolve_all();
 
-    // Prevent tearing
-    int dummy = 0;
-    ioctl(g_fb.fb_fd, FBIO_WAITFORVSYNC, &dummy);
+    // Prevent tearing. With page flipping the copy goes to the hidden page
+    // and the flip itself is synchronised by the driver, so no wait here.
+    // When vsync paced, the main loop only calls us right after a vblank.
+    // DRM flips are asynchronous, so the back buffer may still be on screen
+    // until the last one completes.
+    bool flip = (g_fb.pages > 1);
+    if (g_fb.drm) {
+        drm_wait_idle();
+        g_damage_count = 0;
+    }
+    if (!flip && !g_fb.vsync_paced && !g_fb.direct) {
+        int dummy = 0;
+        if (g_fb.offscreen) offscreen_wait_vsync(app_config.vsync_hz);
+        else ioctl(g_fb.fb_fd, FBIO_WAITFORVSYNC, &dummy);
+    }
 
-    int fb_stride = g_fb.finfo.line_length;
-    int dst_x_offset_bytes = (g_fb.offset_x * g_fb.bpp);
+    int page = g_fb.back_page;
+    uint8_t* dst_base = g_fb.page_mem[page];
+    uint8_t* shadow_base = (uint8_t*)g_fb.shadow_buffer + (size_t)page * g_fb.height * g_fb.native_stride;
+    BlitFrame frame = { 0, 0, 0, -1, g_fb.drm ? dst_base : (const uint8_t*)g_fb.fb_mem };
+
+    // BLIT_DIFF / BLIT_PAGES compare against the shadow of the framebuffer and
+    // skip unchanged bytes. An invalid shadow is refreshed with a plain copy.
+    BlitMode mode = g_fb.blit_mode;
+    if (mode != BLIT_COPY && !g_fb.shadow_valid[page]) {
+        if (g_fb.rotation) {
+            for (int ty = 0; ty < g_fb.tile_rows; ty++) {
+                for (int tx = 0; tx < g_fb.tile_cols; tx++) rotate_tile(tx, ty, shadow_base, g_fb.out_w, 0);
+            }
+        } else {
+            for (int y = 0; y < g_fb.height; y++) {
+                uint8_t* row = shadow_base + (y * g_fb.native_stride);
+                const uint8_t* src = native_pixels(0, y, g_fb.width, row);
+                if (src != row) memcpy(row, src, g_fb.native_stride);
+            }
+        }
+        g_fb.shadow_valid[page] = true;
+        mode = BLIT_COPY;
+    }
 
-    // OPTIMIZATION: Render buffer is native format -> simple memcpy
-    for (int y = dirty_min_y; y < dirty_max_y; y++) {
-        if ((y + g_fb.offset_y) >= g_fb.vinfo.yres) break;
+    if (g_fb.direct) count_direct(&frame);
+    else if (g_fb.rotation) blit_rotated(&frame, mode, dst_base, shadow_base, flip);
+    else blit_tiles(&frame, mode, dst_base, shadow_base, flip);
 
-        uint8_t* src_row = (uint8_t*)g_fb.render_buffer + (y * g_fb.stride);
-        uint8_t* dst_row = (uint8_t*)g_fb.fb_mem + 
-                           ((y + g_fb.offset_y) * fb_stride) + 
-                           dst_x_offset_bytes;
+    uint32_t bbox_bytes;
+    if (g_fb.rotation) {
+        bbox_bytes = (dirty_max_y - dirty_min_y) * (dirty_max_x - dirty_min_x) * g_fb.fbpp;
+    } else if (g_fb.scaled) {
+        bbox_bytes = (row_start[dirty_max_y] - row_start[dirty_min_y]) *
+                     (col_start[dirty_max_x] - col_start[dirty_min_x]) * g_fb.fbpp;
+    } else {
+        int bbox_h = dirty_max_y;
+        if (bbox_h + g_fb.offset_y > (int)g_fb.vinfo.yres) bbox_h = g_fb.vinfo.yres - g_fb.offset_y;
+        bbox_h -= dirty_min_y;
+        bbox_bytes = (bbox_h > 0) ? bbox_h * (dirty_max_x - dirty_min_x) * g_fb.fbpp : 0;
+    }
 
-        int start_offset = dirty_min_x * g_fb.bpp;
-        int copy_size = (dirty_max_x - dirty_min_x) * g_fb.bpp;
+    g_stats.blits++;
+    g_stats.bytes_copied += frame.bytes;
+    g_stats.bytes_bbox += bbox_bytes;
+    g_stats.bytes_skipped += frame.skipped;
+    g_stats.pixels_dirty += (frame.bytes + frame.skipped) / g_fb.fbpp;
+    g_stats.pages_dirtied += frame.pages;
+    g_stats.last_frame_bytes = frame.bytes;
+    g_stats.last_frame_bbox_bytes = bbox_bytes;
+    g_stats.last_frame_pages = frame.pages;
 
-        memcpy(dst_row + start_offset, src_row + start_offset, copy_size);
+    if (flip) {
+        if (g_fb.drm) drm_present(page, g_damage, g_damage_count);
+        else pan_to_page(page);
+        g_fb.back_page = page ^ 1;
+        memcpy(prev_tiles, dirty_tiles, sizeof(prev_tiles));
     }
 
-    dirty_min_x = M8_WIDTH;
-    dirty_min_y = M8_HEIGHT;
-    dirty_max_x = -1;
-    dirty_max_y = -1;
+    clear_dirty();
 }
 
-void display_draw_rect(int x, int y, int w, int h, uint8_t r, uint8_t g, uint8_t b) {
+int display_get_vsync_fd(void) {
+    if (!g_fb.vsync_paced) return -1;
+    return g_fb.drm ? drm_get_fd() : vsync_get_fd();
+}
+
+bool display_vsync_ack(void) {
+    return g_fb.drm ? drm_ack() : vsync_ack();
+}
+
+const DisplayStats* display_get_stats(void) {
+    return &g_stats;
+}
+
+void display_print_stats(void) {
+    if (g_stats.blits == 0) return;
+    double saved = (double)g_stats.bytes_bbox - (double)g_stats.bytes_copied;
+    printf("Display: %llu blits, %llu B/frame (bbox %llu B/frame, saved %.1f%%)\n",
+           (unsigned long long)g_stats.blits,
+           (unsigned long long)(g_stats.bytes_copied / g_stats.blits),
+           (unsigned long long)(g_stats.bytes_bbox / g_stats.blits),
+           g_stats.bytes_bbox ? 100.0 * saved / g_stats.bytes_bbox : 0.0);
+    if (g_fb.rbpp == 1) printf("Display: indexed render buffer, %d palette colors\n", g_pal.count);
+    uint64_t cells = g_stats.cell_hits + g_stats.cell_misses;
+    printf("Display: char cells %llu hits / %llu misses (%.1f%% skipped)\n",
+           (unsigned long long)g_stats.cell_hits, (unsigned long long)g_stats.cell_misses,
+           cells ? 100.0 * g_stats.cell_hits / cells : 0.0);
+    printf("Display: %.1f pages/frame dirtied, %llu B/frame skipped as unchanged\n",
+           (double)g_stats.pages_dirtied / g_stats.blits,
+           (unsigned long long)(g_stats.bytes_skipped / g_stats.blits));
+    printf("Display: %llu background tiles deferred, %.1f%% overdrawn before being filled\n",
+           (unsigned long long)g_stats.tiles_deferred,
+           g_stats.tiles_deferred ? 100.0 * (g_stats.tiles_deferred - g_stats.tiles_filled) / g_stats.tiles_deferred : 0.0);
+    if (g_stats.cmds_queued) {
+        printf("Display: %llu draw commands queued, %.1f%% culled as overdrawn, %llu rects merged\n",
+               (unsigned long long)g_stats.cmds_queued,
+               100.0 * g_stats.cmds_culled / g_stats.cmds_queued,
+               (unsigned long long)g_stats.rects_merged);
+    }
+}
+
+static void raster_rect(int x, int y, int w, int h, uint8_t r, uint8_t g, uint8_t b) {
     const struct inline_font* font = get_font_ptr(current_font_idx);
-    
+    bool full_screen = (w >= g_fb.width && h >= g_fb.height);
+
+    // A full-screen clear leaves a single color, so the palette starts over
+    if (full_screen && g_fb.rbpp == 1) palette_reset();
+    palette_reserve(1);
+
     // Pre-calculate native color
     uint32_t color = pack_color(r, g, b);
     
     // Check for Full Screen / Background Clear
-    if (w >= M8_WIDTH && h >= M8_HEIGHT) {
+    if (full_screen) {
         global_bg_color = color;
-        // Fast clear
-        if (color == 0 || (g_fb.bpp == 4 && color == 0xFF000000)) {
-            memset(g_fb.render_buffer, 0, M8_WIDTH * M8_HEIGHT * g_fb.bpp);
-        } else {
-            // Manual fill
-            if (g_fb.bpp == 4) {
-                uint32_t *ptr = (uint32_t*)g_fb.render_buffer;
-                int total = M8_WIDTH * M8_HEIGHT;
-                while(total--) *ptr++ = color;
-            } else {
-                uint16_t *ptr = (uint16_t*)g_fb.render_buffer;
-                int total = M8_WIDTH * M8_HEIGHT;
-                while(total--) *ptr++ = (uint16_t)color;
-            }
-        }
-        dirty_min_x = 0; dirty_min_y = 0;
-        dirty_max_x = M8_WIDTH; dirty_max_y = M8_HEIGHT;
+        defer_tiles(0, g_fb.tile_rows, tile_span_mask(0, g_fb.tile_cols), color);
+        reset_cells();
+        reset_wave();
+        mark_all_dirty();
         return;
     } 
     
@@ -208,42 +1619,60 @@ void display_draw_rect(int x, int y, int w, int h, uint8_t r, uint8_t g, uint8_t
     // Clipping
     if (x < 0) { w += x; x = 0; }
     if (y < 0) { h += y; y = 0; }
-    if (x + w > M8_WIDTH) w = M8_WIDTH - x;
-    if (y + h > M8_HEIGHT) h = M8_HEIGHT - y;
+    if (x + w > g_fb.width) w = g_fb.width - x;
+    if (y + h > g_fb.height) h = g_fb.height - y;
     
     if (w <= 0 || h <= 0) return;
 
     mark_dirty(x, y, w, h);
+    invalidate_cells(x, y, w, h);
+    invalidate_wave(x, y, w);
+
+    // Tiles [ftx0, ftx1) x [fty0, fty1) lie entirely inside the rect and are
+    // deferred. The rest of it is drawn now.
+    int ftx0 = (x + TILE_SIZE - 1) >> TILE_SHIFT, ftx1 = (x + w) >> TILE_SHIFT;
+    int fty0 = (y + TILE_SIZE - 1) >> TILE_SHIFT, fty1 = (y + h) >> TILE_SHIFT;
+    uint32_t full = (ftx0 < ftx1 && fty0 < fty1) ? tile_span_mask(ftx0, ftx1) : 0;
+    cover_rect(x, y, w, h);
+    if (full) defer_tiles(fty0, fty1, full, color);
 
     // Drawing loops
-    if (g_fb.bpp == 4) {
-        uint32_t c = (uint32_t)color;
-        for (int j = 0; j < h; j++) {
-            uint32_t* row_ptr = (uint32_t*)g_fb.render_buffer + ((y + j) * M8_WIDTH) + x;
-            int cols = w;
-            while(cols--) *row_ptr++ = c;
-        }
-    } else {
-        uint16_t c = (uint16_t)color;
-        for (int j = 0; j < h; j++) {
-            uint16_t* row_ptr = (uint16_t*)g_fb.render_buffer + ((y + j) * M8_WIDTH) + x;
-            int cols = w;
-            while(cols--) *row_ptr++ = c;
+    int full_x0 = ftx0 << TILE_SHIFT, full_x1 = ftx1 << TILE_SHIFT;
+    for (int j = 0; j < h; j++) {
+        int ty = (y + j) >> TILE_SHIFT;
+        if (full && ty >= fty0 && ty < fty1) {
+            if (full_x0 > x) fill_pixels(render_ptr(x, y + j), color, full_x0 - x);
+            if (x + w > full_x1) fill_pixels(render_ptr(full_x1, y + j), color, x + w - full_x1);
+        } else {
+            fill_pixels(render_ptr(x, y + j), color, w);
         }
     }
 }
 
-void display_draw_char(char c, int x, int y, uint8_t fr, uint8_t fg, uint8_t fb, uint8_t br, uint8_t bg, uint8_t bb) {
+static void raster_char(char c, int x, int y, uint8_t fr, uint8_t fg, uint8_t fb, uint8_t br, uint8_t bg, uint8_t bb) {
     const struct inline_font* font = get_font_ptr(current_font_idx);
-    
-    y += font->text_offset_y + font->screen_offset_y;
 
+    palette_reserve(2);
     uint32_t fore = pack_color(fr, fg, fb);
     uint32_t back = pack_color(br, bg, bb);
 
     int w = font->glyph_x;
     int h = font->glyph_y;
 
+    // Skip characters that are already on screen
+    CharCell* cell = NULL;
+    if (x >= 0 && y >= 0 && x / w < CELL_COLS && y / h < CELL_ROWS) {
+        cell = &char_cells[y / h][x / w];
+        if (cell->x == x && cell->y == y && cell->c == c && cell->fore == fore && cell->back == back) {
+            g_stats.cell_hits++;
+            return;
+        }
+    }
+    g_stats.cell_misses++;
+
+    int cell_x = x, cell_y = y;
+    y += font->text_offset_y + font->screen_offset_y;
+
     int draw_x = x, draw_y = y;
     int draw_w = w, draw_h = h;
     int img_off_x = 0, img_off_y = 0;
@@ -251,145 +1680,363 @@ void display_draw_char(char c, int x, int y, uint8_t fr, uint8_t fg, uint8_t fb,
     // Clipping
     if (draw_x < 0) { draw_w += draw_x; img_off_x = -draw_x; draw_x = 0; }
     if (draw_y < 0) { draw_h += draw_y; img_off_y = -draw_y; draw_y = 0; }
-    if (draw_x + draw_w > M8_WIDTH) draw_w = M8_WIDTH - draw_x;
-    if (draw_y + draw_h > M8_HEIGHT) draw_h = M8_HEIGHT - draw_y;
+    if (draw_x + draw_w > g_fb.width) draw_w = g_fb.width - draw_x;
+    if (draw_y + draw_h > g_fb.height) draw_h = g_fb.height - draw_y;
 
     if (draw_w <= 0 || draw_h <= 0) return;
 
     mark_dirty(draw_x, draw_y, draw_w, draw_h);
+    invalidate_cells(draw_x, draw_y, draw_w, draw_h);
+    invalidate_wave(draw_x, draw_y, draw_w);
+    if (cell) {
+        cell->x = cell_x; cell->y = cell_y; cell->c = c;
+        cell->fore = fore; cell->back = back;
+    }
 
     // Handle Space
     if (c == 32) {
-        if (g_fb.bpp == 4) {
-            for(int j = 0; j < draw_h; j++) {
-                uint32_t* buf = (uint32_t*)g_fb.render_buffer + ((draw_y + j) * M8_WIDTH) + draw_x;
-                int k = draw_w; while(k--) *buf++ = back;
-            }
-        } else {
-            for(int j = 0; j < draw_h; j++) {
-                uint16_t* buf = (uint16_t*)g_fb.render_buffer + ((draw_y + j) * M8_WIDTH) + draw_x;
-                int k = draw_w; while(k--) *buf++ = (uint16_t)back;
-            }
+        cover_rect(draw_x, draw_y, draw_w, draw_h);
+        for(int j = 0; j < draw_h; j++) {
+            fill_pixels(render_ptr(draw_x, draw_y + j), back, draw_w);
         }
         return;
     }
 
     int char_idx = c - 33; 
-    if (char_idx < 0) return; 
+    if (char_idx < 0 || char_idx >= GLYPH_COUNT) return; 
 
-    int32_t bmp_w = *(int32_t*)&font->image_data[18];
-    int32_t bmp_h = *(int32_t*)&font->image_data[22];
-    uint32_t data_offset = *(uint32_t*)&font->image_data[10];
-    
-    int row_stride = ((bmp_w + 31) / 32) * 4;
-    int chars_per_row = 94; 
-    int src_base_x = (char_idx % chars_per_row) * (bmp_w / chars_per_row);
-    int src_base_y = (char_idx / chars_per_row) * font->height;
+    const uint16_t* glyph = glyph_atlas[font_slot(current_font_idx)].rows[char_idx] + img_off_y;
+    bool opaque = (fore != back);
+    // Transparent glyphs keep the pixels under clear bits, so those must exist
+    if (opaque) cover_rect(draw_x, draw_y, draw_w, draw_h);
+    else resolve_rect(draw_x, draw_y, draw_w, draw_h);
 
-    // Split loop to avoid 'if(bpp)' inside pixel iteration
-    if (g_fb.bpp == 4) {
-        for(int j = 0; j < draw_h; j++) {
-            int buf_y = draw_y + j;
-            int src_y_local = src_base_y + j + img_off_y;
-            int bmp_row = (bmp_h - 1) - src_y_local;
-            const uint8_t* bmp_row_data = &font->image_data[data_offset + (bmp_row * row_stride)];
-            
-            uint32_t* buf_ptr = (uint32_t*)g_fb.render_buffer + (buf_y * M8_WIDTH) + draw_x;
-            int start_x = src_base_x + img_off_x;
-
-            for(int i = 0; i < draw_w; i++) {
-                int cur_x = start_x + i;
-                // Manual bit extraction
-                uint8_t byte = bmp_row_data[cur_x >> 3];
-                uint8_t pixel = (byte >> (7 - (cur_x & 7))) & 1;
-                if(pixel) buf_ptr[i] = fore;
-                else if (fore != back) buf_ptr[i] = back;
-            }
-        }
-    } else {
-        // 16-bit Path
-        uint16_t f16 = (uint16_t)fore;
-        uint16_t b16 = (uint16_t)back;
-        for(int j = 0; j < draw_h; j++) {
-            int buf_y = draw_y + j;
-            int src_y_local = src_base_y + j + img_off_y;
-            int bmp_row = (bmp_h - 1) - src_y_local;
-            const uint8_t* bmp_row_data = &font->image_data[data_offset + (bmp_row * row_stride)];
-            
-            uint16_t* buf_ptr = (uint16_t*)g_fb.render_buffer + (buf_y * M8_WIDTH) + draw_x;
-            int start_x = src_base_x + img_off_x;
-
-            for(int i = 0; i < draw_w; i++) {
-                int cur_x = start_x + i;
-                uint8_t byte = bmp_row_data[cur_x >> 3];
-                uint8_t pixel = (byte >> (7 - (cur_x & 7))) & 1;
-                if(pixel) buf_ptr[i] = f16;
-                else if (f16 != b16) buf_ptr[i] = b16;
-            }
-        }
+    // Whole rows go through the glyph kernels, no 'if(bpp)' per pixel. Bits
+    // are left-aligned in a 32-bit word with the clipped columns shifted out.
+    for(int j = 0; j < draw_h; j++) {
+        glyph_pixels(render_ptr(draw_x, draw_y + j), (uint32_t)glyph[j] << (16 + img_off_x), draw_w, fore, back, opaque);
     }
 }
 
-void display_draw_waveform(uint8_t r, uint8_t g, uint8_t b, uint8_t* data, int size) {
+static void raster_waveform(uint8_t r, uint8_t g, uint8_t b, uint8_t* data, int size) {
+    palette_reserve(1);
     uint32_t color = pack_color(r, g, b);
+    uint32_t native = pack_native(r, g, b);
     const struct inline_font* font = get_font_ptr(current_font_idx);
     int max_h = font->waveform_max_height;
 
+    // A different strip height leaves nothing of the old model usable
+    if (max_h != wave_max_h) {
+        for (int c = 0; c < g_fb.width; c++) wave_cols[c].known = false;
+        wave_max_h = max_h;
+    }
+
     int clear_w = (size > 0) ? size : prev_waveform_size;
-    int clear_x = M8_WIDTH - clear_w;
-    
-    mark_dirty(clear_x, 0, clear_w, max_h + 1);
-
-    // Clear previous area
-    if (g_fb.bpp == 4) {
-        for(int j=0; j <= max_h; j++) {
-            uint32_t* row = (uint32_t*)g_fb.render_buffer + (j * M8_WIDTH) + clear_x;
-            for(int i=0; i < clear_w; i++) {
-                if(clear_x + i < M8_WIDTH) row[i] = global_bg_color;
-            }
+    if (clear_w > g_fb.width) clear_w = g_fb.width;
+    int clear_x = g_fb.width - clear_w;
+    prev_waveform_size = size;
+    if (clear_w > 0) resolve_rect(clear_x, 0, clear_w, max_h + 1);
+
+    // Rows written per column, for damage and cell invalidation
+    int ylo[M8_MAX_WIDTH], yhi[M8_MAX_WIDTH];
+    for (int c = clear_x; c < g_fb.width; c++) { ylo[c] = g_fb.height; yhi[c] = -1; }
+
+    // Columns drawn over by something else are cleared in full, whole rows
+    // at a time
+    for (int c = clear_x; c < g_fb.width; ) {
+        if (wave_cols[c].known) { c++; continue; }
+        int c0 = c;
+        for (; c < g_fb.width && !wave_cols[c].known; c++) {
+            wave_cols[c].lo = 1;
+            wave_cols[c].hi = 0;
+            wave_cols[c].known = true;
+            ylo[c] = 0;
+            yhi[c] = max_h;
         }
-    } else {
-        uint16_t bg16 = (uint16_t)global_bg_color;
-        for(int j=0; j <= max_h; j++) {
-            uint16_t* row = (uint16_t*)g_fb.render_buffer + (j * M8_WIDTH) + clear_x;
-            for(int i=0; i < clear_w; i++) {
-                if(clear_x + i < M8_WIDTH) row[i] = bg16;
-            }
+        for (int j = 0; j <= max_h; j++) fill_pixels(render_ptr(c0, j), global_bg_color, c - c0);
+    }
+
+    // New spans. Segment i runs from column base + i - 1 to base + i.
+    int16_t lo[M8_MAX_WIDTH], hi[M8_MAX_WIDTH];
+    for (int c = clear_x; c < g_fb.width; c++) { lo[c] = g_fb.height; hi[c] = -1; }
+    int base = g_fb.width - size;
+    int prev_y = (size > 0 && data[0] < max_h) ? data[0] : max_h;
+    for (int i = 1; i < size; i++) {
+        int y = data[i];
+        if (y > max_h) y = max_h;
+        int m = abs(y - prev_y), s = (y < prev_y) ? -1 : 1;
+        int xa = base + i - 1, xb = base + i;
+        if (xa >= 0) span_add(&lo[xa], &hi[xa], prev_y, prev_y + s * (wave_split[m][0] - 1));
+        if (xb >= 0) span_add(&lo[xb], &hi[xb], prev_y + s * wave_split[m][1], y);
+        prev_y = y;
+    }
+
+    // Erase what the old trace no longer covers, draw what the new one adds
+    int dx0 = g_fb.width, dx1 = -1, dy0 = g_fb.height, dy1 = -1;
+    for (int c = clear_x; c < g_fb.width; c++) {
+        WaveColumn* col = &wave_cols[c];
+        fill_column_outside(c, col->lo, col->hi, lo[c], hi[c], global_bg_color, &ylo[c], &yhi[c]);
+        if (col->lo > col->hi || col->native != native) {
+            fill_column(c, lo[c], hi[c], color, &ylo[c], &yhi[c]);
+        } else {
+            fill_column_outside(c, lo[c], hi[c], col->lo, col->hi, color, &ylo[c], &yhi[c]);
         }
+        col->lo = lo[c];
+        col->hi = hi[c];
+        col->native = native;
+
+        if (ylo[c] > yhi[c]) continue;
+        if (c < dx0) dx0 = c;
+        dx1 = c;
+        if (ylo[c] < dy0) dy0 = ylo[c];
+        if (yhi[c] > dy1) dy1 = yhi[c];
     }
+    if (dx0 > dx1) return;
 
-    prev_waveform_size = size;
-    if (size == 0) return;
+    // The trace is exact pixels, so no text padding
+    mark_region(dx0, dy0, dx1 + 1, dy1 + 1);
+    invalidate_cells(dx0, dy0, dx1 - dx0 + 1, dy1 - dy0 + 1);
+}
 
-    mark_dirty(M8_WIDTH - size, 0, size, 255);
+// --- Optimization: Frame Command List ---
+// With draw_batch=1 the draw calls only append to a per-frame list that is
+// rasterised in one go before the blit (or when the list fills up, or the
+// font changes). The M8 paints over the same areas several times per frame
+// during screen transitions and fast cursor movement, so the list is first
+// walked backwards with a 1-bit-per-pixel coverage map, and commands whose
+// pixels all end up under later opaque rects or characters are dropped.
+// Same-color rects that extend the previous one are merged as they arrive.
+#define CMD_LIST_SIZE 2048
+#define CMD_WAVE_BYTES 4096
 
-    int prev_x = M8_WIDTH - size;
-    int prev_y = data[0];
-    
-    for(int i=1; i<size; i++) {
-        int x = (M8_WIDTH - size) + i;
-        int y = data[i];
-        if(y > max_h) y = max_h;
-        
-        int x0=prev_x, y0=prev_y, x1=x, y1=y;
-        int dx = abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
-        int dy = -abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
-        int err = dx + dy, e2;
+typedef struct {
+    uint8_t type;
+    char c;
+    bool opaque;        // Writes every pixel of its box
+    bool culled;
+    uint8_t rgb[6];     // Rect/waveform color, or char fore + back
+    int x, y, w, h;     // Call arguments. Waveforms: x = offset into cmd_wave_data, w = size
+    int16_t bx0, by0, bx1, by1; // Render buffer pixels the command may write
+} DrawCmd;
 
-        while (1) {
-            if (x0 >= 0 && x0 < M8_WIDTH && y0 >= 0 && y0 < M8_HEIGHT) {
-                if (g_fb.bpp == 4) {
-                    ((uint32_t*)g_fb.render_buffer)[y0 * M8_WIDTH + x0] = color;
-                } else {
-                    ((uint16_t*)g_fb.render_buffer)[y0 * M8_WIDTH + x0] = (uint16_t)color;
-                }
+static DrawCmd cmd_list[CMD_LIST_SIZE];
+static int cmd_count;
+static uint8_t cmd_wave_data[CMD_WAVE_BYTES];
+static int cmd_wave_used;
+static uint32_t cull_rows[M8_MAX_HEIGHT][COVER_WORDS];
+
+static void set_box(DrawCmd* cmd, int x, int y, int w, int h) {
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > g_fb.width) w = g_fb.width - x;
+    if (y + h > g_fb.height) h = g_fb.height - y;
+    if (w <= 0 || h <= 0) x = y = w = h = 0;
+    cmd->bx0 = x; cmd->by0 = y;
+    cmd->bx1 = x + w; cmd->by1 = y + h;
+}
+
+static inline bool is_full_screen(const DrawCmd* cmd) {
+    return cmd->type == DRAW_RECT && cmd->w >= g_fb.width && cmd->h >= g_fb.height;
+}
+
+// Work out where each command lands, tracking the state the rasterisers
+// would see: the background color for relative rects, the waveform width.
+static void compute_boxes(void) {
+    const struct inline_font* font = get_font_ptr(current_font_idx);
+    uint32_t bg = (g_fb.rbpp == 1) ? g_pal.native[global_bg_color] : global_bg_color;
+    int wave_size = prev_waveform_size;
+
+    for (int i = 0; i < cmd_count; i++) {
+        DrawCmd* cmd = &cmd_list[i];
+        const uint8_t* c = cmd->rgb;
+        switch (cmd->type) {
+        case DRAW_RECT:
+            cmd->opaque = true;
+            if (is_full_screen(cmd)) {
+                bg = pack_native(c[0], c[1], c[2]);
+                set_box(cmd, 0, 0, g_fb.width, g_fb.height);
+            } else {
+                bool is_absolute = (c[0] == 0 && c[1] == 0 && c[2] == 0) || pack_native(c[0], c[1], c[2]) == bg;
+                set_box(cmd, cmd->x, cmd->y + (is_absolute ? 0 : font->screen_offset_y), cmd->w, cmd->h);
             }
-            if (x0 == x1 && y0 == y1) break;
-            e2 = 2 * err;
-            if (e2 >= dy) { err += dy; x0 += sx; }
-            if (e2 <= dx) { err += dx; y0 += sy; }
+            break;
+        case DRAW_CHAR: {
+            int idx = cmd->c - 33;
+            cmd->opaque = (cmd->c == 32) || (idx >= 0 && idx < GLYPH_COUNT &&
+                          pack_native(c[0], c[1], c[2]) != pack_native(c[3], c[4], c[5]));
+            set_box(cmd, cmd->x, cmd->y + font->text_offset_y + font->screen_offset_y, font->glyph_x, font->glyph_y);
+            break;
         }
-        prev_x = x;
-        prev_y = y;
+        case DRAW_WAVE: {
+            int clear_w = (cmd->w > 0) ? cmd->w : wave_size;
+            if (clear_w > g_fb.width) clear_w = g_fb.width;
+            wave_size = cmd->w;
+            cmd->opaque = false;
+            set_box(cmd, g_fb.width - clear_w, 0, clear_w, font->waveform_max_height + 1);
+            break;
+        }
+        }
+    }
+}
+
+// Mark every command that later opaque ones paint over completely
+static void cull_commands(void) {
+    memset(cull_rows, 0, sizeof(cull_rows));
+    bool full_later = false;
+
+    for (int i = cmd_count - 1; i >= 0; i--) {
+        DrawCmd* cmd = &cmd_list[i];
+        bool empty = (cmd->bx0 >= cmd->bx1);
+        BitSpan span = bit_span(cmd->bx0, empty ? cmd->bx0 + 1 : cmd->bx1);
+
+        // A full-screen clear also resets the background color and models,
+        // so only another one can stand in for it
+        bool covered;
+        if (is_full_screen(cmd)) {
+            covered = full_later;
+            full_later = true;
+        } else {
+            covered = true;
+            for (int y = cmd->by0; y < cmd->by1 && covered; y++) covered = bit_span_full(cull_rows[y], &span);
+        }
+
+        cmd->culled = covered;
+        if (covered) {
+            g_stats.cmds_culled++;
+            continue;
+        }
+        if (cmd->opaque) {
+            for (int y = cmd->by0; y < cmd->by1; y++) bit_span_set(cull_rows[y], &span);
+        }
+    }
+}
+
+// --- Raster Timing ---
+// Draw calls are rasterised here at blit time with draw_batch, or right away
+// without it. Either way --replay wants the cost per command type.
+static bool g_raster_timing = false;
+static uint64_t raster_t0;
+
+static inline uint64_t raster_clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline void raster_begin(void) {
+    if (g_raster_timing) raster_t0 = raster_clock_ns();
+}
+
+static inline void raster_end(int type) {
+    if (!g_raster_timing) return;
+    g_stats.raster_ns[type] += raster_clock_ns() - raster_t0;
+    g_stats.raster_count[type]++;
+}
+
+void display_set_raster_timing(bool on) {
+    g_raster_timing = on;
+}
+
+static void flush_commands(void) {
+    if (cmd_count == 0) return;
+    compute_boxes();
+    cull_commands();
+
+    for (int i = 0; i < cmd_count; i++) {
+        const DrawCmd* cmd = &cmd_list[i];
+        const uint8_t* c = cmd->rgb;
+        if (cmd->culled) {
+            // The next waveform still clears the width of this one
+            if (cmd->type == DRAW_WAVE) prev_waveform_size = cmd->w;
+            continue;
+        }
+        raster_begin();
+        switch (cmd->type) {
+        case DRAW_RECT: raster_rect(cmd->x, cmd->y, cmd->w, cmd->h, c[0], c[1], c[2]); break;
+        case DRAW_CHAR: raster_char(cmd->c, cmd->x, cmd->y, c[0], c[1], c[2], c[3], c[4], c[5]); break;
+        case DRAW_WAVE: raster_waveform(c[0], c[1], c[2], cmd_wave_data + cmd->x, cmd->w); break;
+        }
+        raster_end(cmd->type);
+    }
+    cmd_count = 0;
+    cmd_wave_used = 0;
+}
+
+static DrawCmd* queue_command(int type) {
+    if (cmd_count == CMD_LIST_SIZE) flush_commands();
+    g_stats.cmds_queued++;
+    DrawCmd* cmd = &cmd_list[cmd_count++];
+    cmd->type = type;
+    return cmd;
+}
+
+// Grow the previous rect by an adjacent one of the same color. Nothing can
+// be drawn between them, and the merge must not turn into a full-screen clear.
+static bool merge_rect(int x, int y, int w, int h, uint8_t r, uint8_t g, uint8_t b) {
+    if (cmd_count == 0 || w <= 0 || h <= 0) return false;
+    DrawCmd* last = &cmd_list[cmd_count - 1];
+    if (last->type != DRAW_RECT || last->w <= 0 || last->h <= 0) return false;
+    if (last->rgb[0] != r || last->rgb[1] != g || last->rgb[2] != b) return false;
+
+    int nx = last->x, ny = last->y, nw = last->w, nh = last->h;
+    if (last->y == y && last->h == h && (last->x + last->w == x || x + w == last->x)) {
+        nx = (x < last->x) ? x : last->x;
+        nw += w;
+    } else if (last->x == x && last->w == w && (last->y + last->h == y || y + h == last->y)) {
+        ny = (y < last->y) ? y : last->y;
+        nh += h;
+    } else {
+        return false;
+    }
+    if (nw >= g_fb.width && nh >= g_fb.height) return false;
+
+    last->x = nx; last->y = ny;
+    last->w = nw; last->h = nh;
+    g_stats.rects_merged++;
+    return true;
+}
+
+void display_draw_rect(int x, int y, int w, int h, uint8_t r, uint8_t g, uint8_t b) {
+    if (!app_config.draw_batch) {
+        raster_begin();
+        raster_rect(x, y, w, h, r, g, b);
+        raster_end(DRAW_RECT);
+        return;
+    }
+    if (merge_rect(x, y, w, h, r, g, b)) return;
+    DrawCmd* cmd = queue_command(DRAW_RECT);
+    cmd->x = x; cmd->y = y;
+    cmd->w = w; cmd->h = h;
+    cmd->rgb[0] = r; cmd->rgb[1] = g; cmd->rgb[2] = b;
+}
+
+void display_draw_char(char c, int x, int y, uint8_t fr, uint8_t fg, uint8_t fb, uint8_t br, uint8_t bg, uint8_t bb) {
+    if (!app_config.draw_batch) {
+        raster_begin();
+        raster_char(c, x, y, fr, fg, fb, br, bg, bb);
+        raster_end(DRAW_CHAR);
+        return;
+    }
+    DrawCmd* cmd = queue_command(DRAW_CHAR);
+    cmd->c = c;
+    cmd->x = x; cmd->y = y;
+    cmd->rgb[0] = fr; cmd->rgb[1] = fg; cmd->rgb[2] = fb;
+    cmd->rgb[3] = br; cmd->rgb[4] = bg; cmd->rgb[5] = bb;
+}
+
+void display_draw_waveform(uint8_t r, uint8_t g, uint8_t b, uint8_t* data, int size) {
+    if (!app_config.draw_batch || size < 0 || size > CMD_WAVE_BYTES) {
+        flush_commands();
+        raster_begin();
+        raster_waveform(r, g, b, data, size);
+        raster_end(DRAW_WAVE);
+        return;
     }
+    if (cmd_wave_used + size > CMD_WAVE_BYTES) flush_commands();
+    DrawCmd* cmd = queue_command(DRAW_WAVE);
+    memcpy(cmd_wave_data + cmd_wave_used, data, size);
+    cmd->x = cmd_wave_used;
+    cmd->w = size;
+    cmd->rgb[0] = r; cmd->rgb[1] = g; cmd->rgb[2] = b;
+    cmd_wave_used += size;
 }
\ No newline at end of file
@@ -2,15 +2,67 @@
 #define DISPLAY_H
 
 #include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+    BLIT_COPY = 0,  // Copy every dirty tile to the framebuffer
+    BLIT_DIFF = 1,  // Skip dirty rows that match a shadow of the framebuffer
+    BLIT_PAGES = 2, // Like DIFF, but trim writes per mmap page (fbtft deferred IO)
+    BLIT_MODE_COUNT
+} BlitMode;
+
+// Draw command types, also indexing the per-type stats
+enum { DRAW_RECT, DRAW_CHAR, DRAW_WAVE, DRAW_TYPE_COUNT };
+
+// Blit counters, accumulated since display_init()
+typedef struct {
+    uint64_t blits;              // display_blit() calls that had damage
+    uint64_t bytes_copied;       // Bytes written to the framebuffer (tile runs)
+    uint64_t bytes_bbox;         // Bytes a single dirty bounding box would have copied
+    uint64_t bytes_skipped;      // Dirty bytes not written because they were unchanged
+    uint64_t pixels_dirty;       // Framebuffer pixels in dirty tiles, written or skipped
+    uint64_t pages_dirtied;      // Framebuffer mmap pages written to
+    uint64_t cell_hits;          // draw_char calls skipped, cell already held that char
+    uint64_t cell_misses;        // draw_char calls that were rasterised
+    uint64_t tiles_deferred;     // Tiles whose background fill was deferred
+    uint64_t tiles_filled;       // Deferred tiles that had to be filled after all
+    uint64_t cmds_queued;        // Draw calls queued with draw_batch
+    uint64_t cmds_culled;        // Queued commands dropped as overdrawn
+    uint64_t rects_merged;       // Rects merged into the previous one
+    uint64_t raster_count[DRAW_TYPE_COUNT]; // Commands rasterised, with raster timing on
+    uint64_t raster_ns[DRAW_TYPE_COUNT];    // Time spent rasterising them
+    uint32_t last_frame_bytes;
+    uint32_t last_frame_bbox_bytes;
+    uint32_t last_frame_pages;
+} DisplayStats;
 
 void display_init(void);
 void display_close(void);
 void display_blit(void);
 
-// Drawing primitives called by the Serial module
+// Vsync pacing: fd readable once per refresh, or -1 when display_blit()
+// should synchronise by itself. Ack the fd before blitting.
+int display_get_vsync_fd(void);
+bool display_vsync_ack(void);
+
+// Drawing primitives called by the Serial module. With draw_batch they are
+// queued and rasterised by display_blit().
 void display_draw_rect(int x, int y, int w, int h, uint8_t r, uint8_t g, uint8_t b);
 void display_draw_char(char c, int x, int y, uint8_t fr, uint8_t fg, uint8_t fb, uint8_t br, uint8_t bg, uint8_t bb);
 void display_draw_waveform(uint8_t r, uint8_t g, uint8_t b, uint8_t* data, int size);
 void display_set_font(int font_index);
+// M8 screen size from the system info packet: 320x240, or 480x320 (Model:02)
+void display_set_geometry(int width, int height);
+
+// Blit strategy, switchable at runtime (SIGUSR1 cycles through the modes)
+void display_set_blit_mode(BlitMode mode);
+BlitMode display_get_blit_mode(void);
+
+// Time every rasterised command into raster_ns (for --replay). Costs two
+// clock reads per command, so it is off otherwise.
+void display_set_raster_timing(bool on);
+
+const DisplayStats* display_get_stats(void);
+void display_print_stats(void);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,565 @@
+#include "drm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+// Only the kernel uapi headers are needed, no libdrm. Toolchains without
+// them build a stub and the fbdev backend stays the only choice.
+#if defined(__has_include)
+#if __has_include(<drm/drm.h>) && __has_include(<drm/drm_mode.h>) && __has_include(<drm/drm_fourcc.h>)
+#define HAVE_DRM 1
+#endif
+#endif
+
+#ifdef HAVE_DRM
+#include <drm/drm.h>
+#include <drm/drm_mode.h>
+#include <drm/drm_fourcc.h>
+
+_Static_assert(sizeof(DrmRect) == sizeof(struct drm_mode_rect), "DrmRect must match drm_mode_rect");
+
+// Value of the plane "type" property for primary planes (not in the uapi)
+#define PLANE_TYPE_PRIMARY 1
+
+#define PTR(p) ((uint64_t)(uintptr_t)(p))
+
+typedef struct {
+    uint32_t handle;
+    uint32_t fb_id;
+    uint64_t size;
+    uint8_t *map;
+} DumbBuffer;
+
+static struct {
+    int fd;
+    int width;
+    int height;
+    uint32_t connector_id;
+    uint32_t crtc_id;
+    int crtc_index;
+    uint32_t plane_id;
+    uint32_t mode_blob;
+    DumbBuffer buf[2];
+    bool flip_pending;
+    bool vblank_events;
+    bool vblank_seen;   // A vblank arrived since the last present
+    // Property ids (0 when the driver does not have the property)
+    uint32_t conn_crtc_id;
+    uint32_t crtc_mode_id, crtc_active;
+    uint32_t plane_fb_id, plane_crtc_id;
+    uint32_t plane_src_x, plane_src_y, plane_src_w, plane_src_h;
+    uint32_t plane_crtc_x, plane_crtc_y, plane_crtc_w, plane_crtc_h;
+    uint32_t plane_damage;
+    // What the output showed before drm_open(), put back by drm_close() so
+    // the console is not left blank
+    struct {
+        bool valid;
+        uint32_t mode_valid;
+        struct drm_mode_modeinfo mode;
+        uint64_t conn_crtc, active;
+        uint64_t fb, crtc, src_x, src_y, src_w, src_h, crtc_x, crtc_y, crtc_w, crtc_h;
+    } saved;
+} g_drm = { .fd = -1 };
+
+static int drm_ioctl(unsigned long req, void *arg) {
+    int ret;
+    do {
+        ret = ioctl(g_drm.fd, req, arg);
+    } while (ret == -1 && (errno == EINTR || errno == EAGAIN));
+    return ret;
+}
+
+// Property id of 'name' on a KMS object, 0 if it has none. Also returns
+// the current value when 'value' is given.
+static uint32_t find_prop(uint32_t obj_id, uint32_t obj_type, const char *name, uint64_t *value) {
+    struct drm_mode_obj_get_properties props;
+    memset(&props, 0, sizeof(props));
+    props.obj_id = obj_id;
+    props.obj_type = obj_type;
+    if (drm_ioctl(DRM_IOCTL_MODE_OBJ_GETPROPERTIES, &props) == -1 || props.count_props == 0) return 0;
+
+    uint32_t *ids = calloc(props.count_props, sizeof(uint32_t));
+    uint64_t *values = calloc(props.count_props, sizeof(uint64_t));
+    props.props_ptr = PTR(ids);
+    props.prop_values_ptr = PTR(values);
+
+    uint32_t found = 0;
+    if (drm_ioctl(DRM_IOCTL_MODE_OBJ_GETPROPERTIES, &props) == 0) {
+        for (uint32_t i = 0; i < props.count_props && !found; i++) {
+            struct drm_mode_get_property prop;
+            memset(&prop, 0, sizeof(prop));
+            prop.prop_id = ids[i];
+            if (drm_ioctl(DRM_IOCTL_MODE_GETPROPERTY, &prop) == 0 && strcmp(prop.name, name) == 0) {
+                found = ids[i];
+                if (value) *value = values[i];
+            }
+        }
+    }
+    free(ids);
+    free(values);
+    return found;
+}
+
+// CRTC driving a connector: its current encoder's, else the first one any
+// of its encoders can use
+static uint32_t pick_crtc(const struct drm_mode_get_connector *conn, const uint32_t *encoders,
+                          const uint32_t *crtcs, int count_crtcs) {
+    struct drm_mode_get_encoder enc;
+    if (conn->encoder_id) {
+        memset(&enc, 0, sizeof(enc));
+        enc.encoder_id = conn->encoder_id;
+        if (drm_ioctl(DRM_IOCTL_MODE_GETENCODER, &enc) == 0 && enc.crtc_id) return enc.crtc_id;
+    }
+    for (uint32_t e = 0; e < conn->count_encoders; e++) {
+        memset(&enc, 0, sizeof(enc));
+        enc.encoder_id = encoders[e];
+        if (drm_ioctl(DRM_IOCTL_MODE_GETENCODER, &enc) == -1) continue;
+        for (int c = 0; c < count_crtcs; c++) {
+            if (enc.possible_crtcs & (1u << c)) return crtcs[c];
+        }
+    }
+    return 0;
+}
+
+// First connected connector with a mode and a usable CRTC
+static bool pick_output(const char *mode_str, struct drm_mode_modeinfo *mode) {
+    struct drm_mode_card_res res;
+    memset(&res, 0, sizeof(res));
+    if (drm_ioctl(DRM_IOCTL_MODE_GETRESOURCES, &res) == -1) return false;
+
+    uint32_t *crtcs = calloc(res.count_crtcs + 1, sizeof(uint32_t));
+    uint32_t *connectors = calloc(res.count_connectors + 1, sizeof(uint32_t));
+    uint32_t *encoders = calloc(res.count_encoders + 1, sizeof(uint32_t));
+    res.count_fbs = 0;
+    res.crtc_id_ptr = PTR(crtcs);
+    res.connector_id_ptr = PTR(connectors);
+    res.encoder_id_ptr = PTR(encoders);
+    bool ok = false;
+    if (drm_ioctl(DRM_IOCTL_MODE_GETRESOURCES, &res) == -1) goto out;
+
+    int want_w = 0, want_h = 0;
+    if (mode_str && *mode_str) sscanf(mode_str, "%dx%d", &want_w, &want_h);
+
+    for (uint32_t i = 0; i < res.count_connectors && !ok; i++) {
+        struct drm_mode_get_connector conn;
+        memset(&conn, 0, sizeof(conn));
+        conn.connector_id = connectors[i];
+        if (drm_ioctl(DRM_IOCTL_MODE_GETCONNECTOR, &conn) == -1) continue;
+        if (conn.connection != 1 || conn.count_modes == 0) continue; // 1 = connected
+
+        struct drm_mode_modeinfo *modes = calloc(conn.count_modes, sizeof(*modes));
+        uint32_t *conn_encoders = calloc(conn.count_encoders + 1, sizeof(uint32_t));
+        conn.modes_ptr = PTR(modes);
+        conn.encoders_ptr = PTR(conn_encoders);
+        conn.count_props = 0;
+        if (drm_ioctl(DRM_IOCTL_MODE_GETCONNECTOR, &conn) == 0 && conn.count_modes > 0) {
+            int pick = 0;
+            for (uint32_t m = 0; m < conn.count_modes; m++) {
+                if (modes[m].type & DRM_MODE_TYPE_PREFERRED) { pick = m; break; }
+            }
+            for (uint32_t m = 0; m < conn.count_modes; m++) {
+                if (modes[m].hdisplay == want_w && modes[m].vdisplay == want_h) { pick = m; break; }
+            }
+
+            uint32_t crtc = pick_crtc(&conn, conn_encoders, crtcs, res.count_crtcs);
+            if (crtc) {
+                *mode = modes[pick];
+                g_drm.connector_id = conn.connector_id;
+                g_drm.crtc_id = crtc;
+                for (uint32_t c = 0; c < res.count_crtcs; c++) {
+                    if (crtcs[c] == crtc) g_drm.crtc_index = c;
+                }
+                ok = true;
+            }
+        }
+        free(modes);
+        free(conn_encoders);
+    }
+
+out:
+    free(crtcs);
+    free(connectors);
+    free(encoders);
+    return ok;
+}
+
+static bool pick_primary_plane(void) {
+    struct drm_mode_get_plane_res res;
+    memset(&res, 0, sizeof(res));
+    if (drm_ioctl(DRM_IOCTL_MODE_GETPLANERESOURCES, &res) == -1 || res.count_planes == 0) return false;
+
+    uint32_t *planes = calloc(res.count_planes, sizeof(uint32_t));
+    res.plane_id_ptr = PTR(planes);
+    if (drm_ioctl(DRM_IOCTL_MODE_GETPLANERESOURCES, &res) == 0) {
+        for (uint32_t i = 0; i < res.count_planes && !g_drm.plane_id; i++) {
+            struct drm_mode_get_plane plane;
+            memset(&plane, 0, sizeof(plane));
+            plane.plane_id = planes[i];
+            if (drm_ioctl(DRM_IOCTL_MODE_GETPLANE, &plane) == -1) continue;
+            if (!(plane.possible_crtcs & (1u << g_drm.crtc_index))) continue;
+
+            uint64_t type = 0;
+            if (find_prop(planes[i], DRM_MODE_OBJECT_PLANE, "type", &type) && type == PLANE_TYPE_PRIMARY) {
+                g_drm.plane_id = planes[i];
+            }
+        }
+    }
+    free(planes);
+    return g_drm.plane_id != 0;
+}
+
+static int create_buffer(DumbBuffer *b, int *pitch) {
+    struct drm_mode_create_dumb create;
+    memset(&create, 0, sizeof(create));
+    create.width = g_drm.width;
+    create.height = g_drm.height;
+    create.bpp = 32;
+    if (drm_ioctl(DRM_IOCTL_MODE_CREATE_DUMB, &create) == -1) return -1;
+    b->handle = create.handle;
+    b->size = create.size;
+    *pitch = create.pitch;
+
+    struct drm_mode_fb_cmd2 fb;
+    memset(&fb, 0, sizeof(fb));
+    fb.width = g_drm.width;
+    fb.height = g_drm.height;
+    fb.pixel_format = DRM_FORMAT_XRGB8888;
+    fb.handles[0] = b->handle;
+    fb.pitches[0] = create.pitch;
+    if (drm_ioctl(DRM_IOCTL_MODE_ADDFB2, &fb) == -1) return -1;
+    b->fb_id = fb.fb_id;
+
+    struct drm_mode_map_dumb map;
+    memset(&map, 0, sizeof(map));
+    map.handle = b->handle;
+    if (drm_ioctl(DRM_IOCTL_MODE_MAP_DUMB, &map) == -1) return -1;
+    b->map = mmap(0, b->size, PROT_READ | PROT_WRITE, MAP_SHARED, g_drm.fd, map.offset);
+    if (b->map == MAP_FAILED) {
+        b->map = NULL;
+        return -1;
+    }
+    memset(b->map, 0, b->size);
+    return 0;
+}
+
+static void destroy_buffer(DumbBuffer *b) {
+    if (b->map) munmap(b->map, b->size);
+    if (b->fb_id) drm_ioctl(DRM_IOCTL_MODE_RMFB, &b->fb_id);
+    if (b->handle) {
+        struct drm_mode_destroy_dumb destroy = { .handle = b->handle };
+        drm_ioctl(DRM_IOCTL_MODE_DESTROY_DUMB, &destroy);
+    }
+    memset(b, 0, sizeof(*b));
+}
+
+// --- Atomic Requests ---
+// Properties are grouped per object, in the order they are added.
+#define ATOMIC_MAX_OBJS 4
+#define ATOMIC_MAX_PROPS 16
+
+typedef struct {
+    uint32_t objs[ATOMIC_MAX_OBJS];
+    uint32_t counts[ATOMIC_MAX_OBJS];
+    uint32_t props[ATOMIC_MAX_PROPS];
+    uint64_t values[ATOMIC_MAX_PROPS];
+    int n_objs;
+    int n_props;
+} AtomicReq;
+
+static void atomic_add(AtomicReq *r, uint32_t obj, uint32_t prop, uint64_t value) {
+    if (!prop || r->n_props == ATOMIC_MAX_PROPS) return;
+    if (r->n_objs == 0 || r->objs[r->n_objs - 1] != obj) {
+        if (r->n_objs == ATOMIC_MAX_OBJS) return;
+        r->objs[r->n_objs] = obj;
+        r->counts[r->n_objs++] = 0;
+    }
+    r->counts[r->n_objs - 1]++;
+    r->props[r->n_props] = prop;
+    r->values[r->n_props++] = value;
+}
+
+static int atomic_commit(AtomicReq *r, uint32_t flags) {
+    struct drm_mode_atomic atomic;
+    memset(&atomic, 0, sizeof(atomic));
+    atomic.flags = flags;
+    atomic.count_objs = r->n_objs;
+    atomic.objs_ptr = PTR(r->objs);
+    atomic.count_props_ptr = PTR(r->counts);
+    atomic.props_ptr = PTR(r->props);
+    atomic.prop_values_ptr = PTR(r->values);
+    return drm_ioctl(DRM_IOCTL_MODE_ATOMIC, &atomic);
+}
+
+static int modeset(const struct drm_mode_modeinfo *mode) {
+    struct drm_mode_create_blob blob;
+    memset(&blob, 0, sizeof(blob));
+    blob.data = PTR(mode);
+    blob.length = sizeof(*mode);
+    if (drm_ioctl(DRM_IOCTL_MODE_CREATEPROPBLOB, &blob) == -1) return -1;
+    g_drm.mode_blob = blob.blob_id;
+
+    uint32_t plane = g_drm.plane_id;
+    AtomicReq r;
+    memset(&r, 0, sizeof(r));
+    atomic_add(&r, g_drm.connector_id, g_drm.conn_crtc_id, g_drm.crtc_id);
+    atomic_add(&r, g_drm.crtc_id, g_drm.crtc_mode_id, g_drm.mode_blob);
+    atomic_add(&r, g_drm.crtc_id, g_drm.crtc_active, 1);
+    atomic_add(&r, plane, g_drm.plane_fb_id, g_drm.buf[0].fb_id);
+    atomic_add(&r, plane, g_drm.plane_crtc_id, g_drm.crtc_id);
+    atomic_add(&r, plane, g_drm.plane_src_x, 0);
+    atomic_add(&r, plane, g_drm.plane_src_y, 0);
+    atomic_add(&r, plane, g_drm.plane_src_w, (uint64_t)g_drm.width << 16); // 16.16 fixed point
+    atomic_add(&r, plane, g_drm.plane_src_h, (uint64_t)g_drm.height << 16);
+    atomic_add(&r, plane, g_drm.plane_crtc_x, 0);
+    atomic_add(&r, plane, g_drm.plane_crtc_y, 0);
+    atomic_add(&r, plane, g_drm.plane_crtc_w, g_drm.width);
+    atomic_add(&r, plane, g_drm.plane_crtc_h, g_drm.height);
+    return atomic_commit(&r, DRM_MODE_ATOMIC_ALLOW_MODESET);
+}
+
+static void save_crtc_mode(void) {
+    struct drm_mode_crtc crtc;
+    memset(&crtc, 0, sizeof(crtc));
+    crtc.crtc_id = g_drm.crtc_id;
+    if (drm_ioctl(DRM_IOCTL_MODE_GETCRTC, &crtc) == -1) return;
+    g_drm.saved.mode_valid = crtc.mode_valid;
+    g_drm.saved.mode = crtc.mode;
+}
+
+// The mode blob the console used is gone once our modeset replaced it, so
+// the mode is saved by value and gets a new blob here
+static void restore_output(void) {
+    uint32_t blob = 0;
+    if (g_drm.saved.mode_valid) {
+        struct drm_mode_create_blob create;
+        memset(&create, 0, sizeof(create));
+        create.data = PTR(&g_drm.saved.mode);
+        create.length = sizeof(g_drm.saved.mode);
+        if (drm_ioctl(DRM_IOCTL_MODE_CREATEPROPBLOB, &create) == 0) blob = create.blob_id;
+    }
+
+    uint32_t plane = g_drm.plane_id;
+    AtomicReq r;
+    memset(&r, 0, sizeof(r));
+    atomic_add(&r, g_drm.connector_id, g_drm.conn_crtc_id, g_drm.saved.conn_crtc);
+    atomic_add(&r, g_drm.crtc_id, g_drm.crtc_mode_id, blob);
+    atomic_add(&r, g_drm.crtc_id, g_drm.crtc_active, g_drm.saved.active);
+    atomic_add(&r, plane, g_drm.plane_fb_id, g_drm.saved.fb);
+    atomic_add(&r, plane, g_drm.plane_crtc_id, g_drm.saved.crtc);
+    atomic_add(&r, plane, g_drm.plane_src_x, g_drm.saved.src_x);
+    atomic_add(&r, plane, g_drm.plane_src_y, g_drm.saved.src_y);
+    atomic_add(&r, plane, g_drm.plane_src_w, g_drm.saved.src_w);
+    atomic_add(&r, plane, g_drm.plane_src_h, g_drm.saved.src_h);
+    atomic_add(&r, plane, g_drm.plane_crtc_x, g_drm.saved.crtc_x);
+    atomic_add(&r, plane, g_drm.plane_crtc_y, g_drm.saved.crtc_y);
+    atomic_add(&r, plane, g_drm.plane_crtc_w, g_drm.saved.crtc_w);
+    atomic_add(&r, plane, g_drm.plane_crtc_h, g_drm.saved.crtc_h);
+    if (atomic_commit(&r, DRM_MODE_ATOMIC_ALLOW_MODESET) == -1) {
+        fprintf(stderr, "DRM: cannot restore the previous mode (%s)\n", strerror(errno));
+    }
+
+    if (blob) {
+        struct drm_mode_destroy_blob destroy = { .blob_id = blob };
+        drm_ioctl(DRM_IOCTL_MODE_DESTROYPROPBLOB, &destroy);
+    }
+}
+
+// Ask for an event at the next vblank of our CRTC
+static void arm_vblank(void) {
+    union drm_wait_vblank vbl;
+    memset(&vbl, 0, sizeof(vbl));
+    vbl.request.type = _DRM_VBLANK_RELATIVE | _DRM_VBLANK_EVENT;
+    vbl.request.type |= (g_drm.crtc_index << _DRM_VBLANK_HIGH_CRTC_SHIFT) & _DRM_VBLANK_HIGH_CRTC_MASK;
+    vbl.request.sequence = 1;
+    drm_ioctl(DRM_IOCTL_WAIT_VBLANK, &vbl);
+}
+
+static void handle_events(void) {
+    char buf[1024];
+    ssize_t len = read(g_drm.fd, buf, sizeof(buf));
+    bool vblank = false;
+    for (ssize_t i = 0; i + (ssize_t)sizeof(struct drm_event) <= len; ) {
+        const struct drm_event *e = (const struct drm_event *)(buf + i);
+        if (e->type == DRM_EVENT_FLIP_COMPLETE) g_drm.flip_pending = false;
+        else if (e->type == DRM_EVENT_VBLANK) vblank = true;
+        if (e->length == 0) break;
+        i += e->length;
+    }
+    if (vblank) {
+        g_drm.vblank_seen = true;
+        if (g_drm.vblank_events) arm_vblank();
+    }
+}
+
+int drm_open(const char *path, const char *mode_str, bool vblank_events, DrmOutput *out) {
+    g_drm.fd = open(path, O_RDWR | O_CLOEXEC);
+    if (g_drm.fd == -1) {
+        fprintf(stderr, "DRM: cannot open %s\n", path);
+        return -1;
+    }
+
+    struct drm_set_client_cap cap = { DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1 };
+    struct drm_set_client_cap atomic_cap = { DRM_CLIENT_CAP_ATOMIC, 1 };
+    if (drm_ioctl(DRM_IOCTL_SET_CLIENT_CAP, &cap) == -1 || drm_ioctl(DRM_IOCTL_SET_CLIENT_CAP, &atomic_cap) == -1) {
+        fprintf(stderr, "DRM: %s has no atomic modesetting\n", path);
+        goto fail;
+    }
+
+    struct drm_mode_modeinfo mode;
+    if (!pick_output(mode_str, &mode)) {
+        fprintf(stderr, "DRM: no connected output on %s\n", path);
+        goto fail;
+    }
+    if (!pick_primary_plane()) {
+        fprintf(stderr, "DRM: no primary plane for CRTC %u\n", g_drm.crtc_id);
+        goto fail;
+    }
+    g_drm.width = mode.hdisplay;
+    g_drm.height = mode.vdisplay;
+
+    // Current values are kept for drm_close()
+    g_drm.conn_crtc_id = find_prop(g_drm.connector_id, DRM_MODE_OBJECT_CONNECTOR, "CRTC_ID", &g_drm.saved.conn_crtc);
+    g_drm.crtc_mode_id = find_prop(g_drm.crtc_id, DRM_MODE_OBJECT_CRTC, "MODE_ID", NULL);
+    g_drm.crtc_active = find_prop(g_drm.crtc_id, DRM_MODE_OBJECT_CRTC, "ACTIVE", &g_drm.saved.active);
+    uint32_t plane = g_drm.plane_id;
+    g_drm.plane_fb_id = find_prop(plane, DRM_MODE_OBJECT_PLANE, "FB_ID", &g_drm.saved.fb);
+    g_drm.plane_crtc_id = find_prop(plane, DRM_MODE_OBJECT_PLANE, "CRTC_ID", &g_drm.saved.crtc);
+    g_drm.plane_src_x = find_prop(plane, DRM_MODE_OBJECT_PLANE, "SRC_X", &g_drm.saved.src_x);
+    g_drm.plane_src_y = find_prop(plane, DRM_MODE_OBJECT_PLANE, "SRC_Y", &g_drm.saved.src_y);
+    g_drm.plane_src_w = find_prop(plane, DRM_MODE_OBJECT_PLANE, "SRC_W", &g_drm.saved.src_w);
+    g_drm.plane_src_h = find_prop(plane, DRM_MODE_OBJECT_PLANE, "SRC_H", &g_drm.saved.src_h);
+    g_drm.plane_crtc_x = find_prop(plane, DRM_MODE_OBJECT_PLANE, "CRTC_X", &g_drm.saved.crtc_x);
+    g_drm.plane_crtc_y = find_prop(plane, DRM_MODE_OBJECT_PLANE, "CRTC_Y", &g_drm.saved.crtc_y);
+    g_drm.plane_crtc_w = find_prop(plane, DRM_MODE_OBJECT_PLANE, "CRTC_W", &g_drm.saved.crtc_w);
+    g_drm.plane_crtc_h = find_prop(plane, DRM_MODE_OBJECT_PLANE, "CRTC_H", &g_drm.saved.crtc_h);
+    save_crtc_mode();
+    g_drm.plane_damage = find_prop(plane, DRM_MODE_OBJECT_PLANE, "FB_DAMAGE_CLIPS", NULL);
+    if (!g_drm.conn_crtc_id || !g_drm.crtc_mode_id || !g_drm.crtc_active || !g_drm.plane_fb_id) {
+        fprintf(stderr, "DRM: missing atomic properties\n");
+        goto fail;
+    }
+
+    int pitch = 0;
+    for (int i = 0; i < 2; i++) {
+        if (create_buffer(&g_drm.buf[i], &pitch) == -1) {
+            fprintf(stderr, "DRM: cannot allocate %dx%d dumb buffers\n", g_drm.width, g_drm.height);
+            goto fail;
+        }
+    }
+    if (modeset(&mode) == -1) {
+        fprintf(stderr, "DRM: atomic modeset failed (%s)\n", strerror(errno));
+        goto fail;
+    }
+    g_drm.saved.valid = true;
+
+    g_drm.vblank_events = vblank_events;
+    if (vblank_events) arm_vblank();
+
+    out->width = g_drm.width;
+    out->height = g_drm.height;
+    out->pitch = pitch;
+    out->bpp = 32;
+    out->pages[0] = g_drm.buf[0].map;
+    out->pages[1] = g_drm.buf[1].map;
+    printf("DRM: %s %dx%d@%u on CRTC %u, plane %u%s\n", path, g_drm.width, g_drm.height, mode.vrefresh,
+           g_drm.crtc_id, g_drm.plane_id, g_drm.plane_damage ? ", damage clips" : "");
+    return 0;
+
+fail:
+    drm_close();
+    return -1;
+}
+
+void drm_close(void) {
+    if (g_drm.fd == -1) return;
+    drm_wait_idle();
+    // Off our buffers before they are destroyed
+    if (g_drm.saved.valid) restore_output();
+    for (int i = 0; i < 2; i++) destroy_buffer(&g_drm.buf[i]);
+    if (g_drm.mode_blob) {
+        struct drm_mode_destroy_blob destroy = { .blob_id = g_drm.mode_blob };
+        drm_ioctl(DRM_IOCTL_MODE_DESTROYPROPBLOB, &destroy);
+    }
+    close(g_drm.fd);
+    memset(&g_drm, 0, sizeof(g_drm));
+    g_drm.fd = -1;
+}
+
+int drm_present(int page, const DrmRect *clips, int count) {
+    // The blob only has to live until the commit has copied it into the state
+    uint32_t blob = 0;
+    if (g_drm.plane_damage && count > 0) {
+        struct drm_mode_create_blob create;
+        memset(&create, 0, sizeof(create));
+        create.data = PTR(clips);
+        create.length = count * sizeof(DrmRect);
+        if (drm_ioctl(DRM_IOCTL_MODE_CREATEPROPBLOB, &create) == 0) blob = create.blob_id;
+    }
+
+    AtomicReq r;
+    memset(&r, 0, sizeof(r));
+    atomic_add(&r, g_drm.plane_id, g_drm.plane_fb_id, g_drm.buf[page].fb_id);
+    if (blob) atomic_add(&r, g_drm.plane_id, g_drm.plane_damage, blob);
+    int ret = atomic_commit(&r, DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT);
+
+    if (blob) {
+        struct drm_mode_destroy_blob destroy = { .blob_id = blob };
+        drm_ioctl(DRM_IOCTL_MODE_DESTROYPROPBLOB, &destroy);
+    }
+    if (ret == 0) {
+        g_drm.flip_pending = true;
+        g_drm.vblank_seen = false;
+    }
+    return ret;
+}
+
+void drm_wait_idle(void) {
+    // Give up after a second rather than hang if an event got lost
+    for (int tries = 0; g_drm.flip_pending && tries < 10; tries++) {
+        struct pollfd p = { g_drm.fd, POLLIN, 0 };
+        if (poll(&p, 1, 100) > 0) handle_events();
+    }
+    g_drm.flip_pending = false;
+}
+
+int drm_get_fd(void) {
+    return g_drm.fd;
+}
+
+bool drm_ack(void) {
+    handle_events();
+    return g_drm.vblank_seen && !g_drm.flip_pending;
+}
+
+#else
+
+int drm_open(const char *path, const char *mode, bool vblank_events, DrmOutput *out) {
+    (void)mode; (void)vblank_events; (void)out;
+    fprintf(stderr, "DRM: built without the kernel DRM headers, cannot use %s\n", path);
+    return -1;
+}
+
+void drm_close(void) {}
+
+int drm_present(int page, const DrmRect *clips, int count) {
+    (void)page; (void)clips; (void)count;
+    return -1;
+}
+
+void drm_wait_idle(void) {}
+
+int drm_get_fd(void) {
+    return -1;
+}
+
+bool drm_ack(void) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef DRM_H
+#define DRM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// DRM/KMS display backend. Drives the first connected connector through its
+// CRTC's primary plane, scanning out one of two XRGB8888 dumb buffers that
+// are presented with atomic page flips. Works on vc4/v3d as well as on the
+// vkms virtual driver for testing without a screen.
+typedef struct {
+    int width;          // Active mode
+    int height;
+    int pitch;          // Bytes per row of each buffer
+    int bpp;            // Bits per pixel
+    uint8_t *pages[2];  // Mapped dumb buffers
+} DrmOutput;
+
+// Matches struct drm_mode_rect: [x1, x2) x [y1, y2) in buffer pixels
+typedef struct {
+    int32_t x1, y1, x2, y2;
+} DrmRect;
+
+// Open 'path' (e.g. /dev/dri/card0) and set a mode: "WxH" if one matches,
+// else the connector's preferred mode. 'vblank_events' requests a vblank
+// event every refresh for pacing. Returns -1 if anything is missing.
+int drm_open(const char *path, const char *mode, bool vblank_events, DrmOutput *out);
+void drm_close(void);
+
+// Queue an atomic flip to 'page'. 'clips' become the plane's FB_DAMAGE_CLIPS
+// when the driver supports them.
+int drm_present(int page, const DrmRect *clips, int count);
+
+// Block until the last flip has completed, so its old buffer can be reused
+void drm_wait_idle(void);
+
+// Pollable DRM fd, readable when vblank or flip events arrive
+int drm_get_fd(void);
+
+// Consume pending events. Returns true on a vblank with no flip in flight.
+bool drm_ack(void);
+
+#endif
@@ -0,0 +1,95 @@
+#include "frame.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+typedef enum {
+    END_NONE,       // Assembler off, or nothing but a redraw request
+    END_WAVEFORM,
+    END_GAP,
+    END_DEADLINE,
+    END_COUNT
+} FrameEnd;
+
+static double fr_gap;         // Seconds, 0 = blit whenever something is dirty
+static double fr_deadline;    // Seconds, 0 = no deadline
+static bool fr_on_waveform;
+
+static int fr_commands;       // Commands of the frame being assembled
+static double fr_first;       // Arrival of its first command
+static double fr_last_data;   // Last serial read that returned data
+static bool fr_waveform;
+static FrameEnd fr_end;
+
+static uint64_t st_frames;
+static uint64_t st_commands;
+static uint64_t st_ends[END_COUNT];
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void frame_init(int gap_ms, int deadline_ms, bool end_on_waveform) {
+    fr_gap = (gap_ms > 0) ? gap_ms / 1000.0 : 0;
+    fr_deadline = (deadline_ms > 0) ? deadline_ms / 1000.0 : 0;
+    fr_on_waveform = end_on_waveform;
+}
+
+void frame_data_received(void) {
+    fr_last_data = now_seconds();
+}
+
+void frame_add_command(bool waveform) {
+    if (fr_commands++ == 0) fr_first = fr_last_data;
+    if (waveform) fr_waveform = true;
+}
+
+bool frame_complete(void) {
+    if (fr_commands == 0 || fr_gap == 0) {
+        fr_end = END_NONE;
+        return true;
+    }
+    if (fr_on_waveform && fr_waveform) {
+        fr_end = END_WAVEFORM;
+        return true;
+    }
+    double now = now_seconds();
+    if (now - fr_last_data >= fr_gap) {
+        fr_end = END_GAP;
+        return true;
+    }
+    if (fr_deadline > 0 && now - fr_first >= fr_deadline) {
+        fr_end = END_DEADLINE;
+        return true;
+    }
+    return false;
+}
+
+int frame_timeout_ms(int max_ms) {
+    if (fr_commands == 0 || fr_gap == 0) return max_ms;
+    double now = now_seconds();
+    double left = fr_gap - (now - fr_last_data);
+    if (fr_deadline > 0 && fr_deadline - (now - fr_first) < left) left = fr_deadline - (now - fr_first);
+    if (left <= 0) return 0;
+    int ms = (int)(left * 1000.0) + 1; // Round up, poll(0) would spin
+    return (ms < max_ms) ? ms : max_ms;
+}
+
+void frame_presented(void) {
+    if (fr_commands == 0) return;
+    st_frames++;
+    st_commands += fr_commands;
+    st_ends[fr_end]++;
+    fr_commands = 0;
+    fr_waveform = false;
+}
+
+void frame_print_stats(void) {
+    if (st_frames == 0) return;
+    printf("Frames: %llu assembled, %.1f commands/frame, ended by waveform %llu / idle gap %llu / deadline %llu\n",
+           (unsigned long long)st_frames, (double)st_commands / st_frames,
+           (unsigned long long)st_ends[END_WAVEFORM], (unsigned long long)st_ends[END_GAP],
+           (unsigned long long)st_ends[END_DEADLINE]);
+}
@@ -0,0 +1,30 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdbool.h>
+
+// Frame assembler. One M8 screen update can span several serial reads, so
+// instead of blitting after every read the main loop waits until the burst
+// looks finished: a waveform packet arrived (the M8 sends it last), the
+// serial port has been idle for frame_gap_ms, or frame_deadline_ms passed
+// since the first command of the frame.
+void frame_init(int gap_ms, int deadline_ms, bool end_on_waveform);
+
+// Serial read returned data, restarts the idle gap
+void frame_data_received(void);
+
+// A draw command was decoded
+void frame_add_command(bool waveform);
+
+// True when the pending commands make up a whole frame (or there are none)
+bool frame_complete(void);
+
+// Poll timeout until frame_complete() can turn true without new data
+int frame_timeout_ms(int max_ms);
+
+// The frame was blitted, start assembling the next one
+void frame_presented(void);
+
+void frame_print_stats(void);
+
+#endif
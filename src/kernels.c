@@ -0,0 +1,556 @@
+#include "kernels.h"
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KERNELS_X86 1
+#endif
+
+// The NEON set lives in kernels_neon.c, the only file built with NEON enabled
+// (ARM_NEON=1), so nothing else can pick up NEON code before the CPU check
+#if defined(__aarch64__) || defined(KERNELS_NEON_BUILT)
+#define KERNELS_NEON 1
+#if !defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+PixelKernels kern;
+
+// --- Scalar (portable fallback, same loops the renderer always used) ---
+
+// Nibble (MSB = first pixel) -> all-ones lanes for set pixels, little endian
+static uint32_t nibble_mask8[16];
+static uint64_t nibble_mask16[16];
+static uint64_t nibble_mask32[16][2];
+
+static void init_nibble_masks(void) {
+    for (int n = 0; n < 16; n++) {
+        nibble_mask8[n] = 0;
+        nibble_mask16[n] = 0;
+        nibble_mask32[n][0] = nibble_mask32[n][1] = 0;
+        for (int p = 0; p < 4; p++) {
+            if (!(n & (8 >> p))) continue;
+            nibble_mask8[n] |= 0xFFu << (p * 8);
+            nibble_mask16[n] |= 0xFFFFull << (p * 16);
+            nibble_mask32[n][p >> 1] |= 0xFFFFFFFFull << ((p & 1) * 32);
+        }
+    }
+}
+
+static void fill16_scalar(uint16_t *dst, uint16_t color, int n) {
+    while (n--) *dst++ = color;
+}
+
+static void fill32_scalar(uint32_t *dst, uint32_t color, int n) {
+    while (n--) *dst++ = color;
+}
+
+static void glyph16_scalar(uint16_t *dst, uint32_t bits, int n, uint16_t fore, uint16_t back, bool opaque) {
+    uint64_t f64 = fore * 0x0001000100010001ull;
+    uint64_t b64 = back * 0x0001000100010001ull;
+    int i = 0;
+    for (; i + 4 <= n; i += 4, bits <<= 4) {
+        uint64_t m = nibble_mask16[bits >> 28];
+        uint64_t px;
+        if (!opaque) memcpy(&px, dst + i, sizeof(px));
+        px = (f64 & m) | ((opaque ? b64 : px) & ~m);
+        memcpy(dst + i, &px, sizeof(px));
+    }
+    for (; i < n; i++, bits <<= 1) {
+        if (bits & 0x80000000u) dst[i] = fore;
+        else if (opaque) dst[i] = back;
+    }
+}
+
+static void glyph32_scalar(uint32_t *dst, uint32_t bits, int n, uint32_t fore, uint32_t back, bool opaque) {
+    uint64_t f64 = ((uint64_t)fore << 32) | fore;
+    uint64_t b64 = ((uint64_t)back << 32) | back;
+    int i = 0;
+    for (; i + 4 <= n; i += 4, bits <<= 4) {
+        const uint64_t *m = nibble_mask32[bits >> 28];
+        uint64_t px[2];
+        if (opaque) {
+            px[0] = (f64 & m[0]) | (b64 & ~m[0]);
+            px[1] = (f64 & m[1]) | (b64 & ~m[1]);
+        } else {
+            memcpy(px, dst + i, sizeof(px));
+            px[0] = (f64 & m[0]) | (px[0] & ~m[0]);
+            px[1] = (f64 & m[1]) | (px[1] & ~m[1]);
+        }
+        memcpy(dst + i, px, sizeof(px));
+    }
+    for (; i < n; i++, bits <<= 1) {
+        if (bits & 0x80000000u) dst[i] = fore;
+        else if (opaque) dst[i] = back;
+    }
+}
+
+static void copy_row_scalar(void *dst, const void *src, size_t bytes) {
+    memcpy(dst, src, bytes);
+}
+
+static void fill8_scalar(uint8_t *dst, uint8_t index, int n) {
+    memset(dst, index, n);
+}
+
+static void glyph8_scalar(uint8_t *dst, uint32_t bits, int n, uint8_t fore, uint8_t back, bool opaque) {
+    uint32_t f32 = fore * 0x01010101u;
+    uint32_t b32 = back * 0x01010101u;
+    int i = 0;
+    for (; i + 4 <= n; i += 4, bits <<= 4) {
+        uint32_t m = nibble_mask8[bits >> 28];
+        uint32_t px;
+        if (!opaque) memcpy(&px, dst + i, sizeof(px));
+        px = (f32 & m) | ((opaque ? b32 : px) & ~m);
+        memcpy(dst + i, &px, sizeof(px));
+    }
+    for (; i < n; i++, bits <<= 1) {
+        if (bits & 0x80000000u) dst[i] = fore;
+        else if (opaque) dst[i] = back;
+    }
+}
+
+static void expand16_scalar(uint16_t *dst, const uint8_t *src, int n, const uint32_t *lut) {
+    for (; n >= 4; n -= 4, dst += 4, src += 4) {
+        dst[0] = (uint16_t)lut[src[0]]; dst[1] = (uint16_t)lut[src[1]];
+        dst[2] = (uint16_t)lut[src[2]]; dst[3] = (uint16_t)lut[src[3]];
+    }
+    while (n--) *dst++ = (uint16_t)lut[*src++];
+}
+
+static void expand32_scalar(uint32_t *dst, const uint8_t *src, int n, const uint32_t *lut) {
+    for (; n >= 4; n -= 4, dst += 4, src += 4) {
+        dst[0] = lut[src[0]]; dst[1] = lut[src[1]];
+        dst[2] = lut[src[2]]; dst[3] = lut[src[3]];
+    }
+    while (n--) *dst++ = lut[*src++];
+}
+
+static void scale16_scalar(uint16_t *dst, const uint16_t *src, int n, int k) {
+    if (k == 2) {
+        // Both copies in one 32-bit store
+        for (int i = 0; i < n; i++, dst += 2) {
+            uint32_t px = src[i] * 0x00010001u;
+            memcpy(dst, &px, sizeof(px));
+        }
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < k; j++) *dst++ = src[i];
+    }
+}
+
+static void scale32_scalar(uint32_t *dst, const uint32_t *src, int n, int k) {
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < k; j++) *dst++ = src[i];
+    }
+}
+
+static void remap16_scalar(uint16_t *dst, const uint16_t *src, const int *map, int n) {
+    for (int i = 0; i < n; i++) dst[i] = src[map[i]];
+}
+
+static void remap32_scalar(uint32_t *dst, const uint32_t *src, const int *map, int n) {
+    for (int i = 0; i < n; i++) dst[i] = src[map[i]];
+}
+
+static void transpose16_scalar(uint16_t *dst, int dst_stride, const uint16_t *src, int src_stride, int w, int h) {
+    for (int i = 0; i < w; i++) {
+        uint16_t *d = dst + (ptrdiff_t)i * dst_stride;
+        for (int j = 0; j < h; j++) d[j] = src[(ptrdiff_t)j * src_stride + i];
+    }
+}
+
+static void transpose32_scalar(uint32_t *dst, int dst_stride, const uint32_t *src, int src_stride, int w, int h) {
+    for (int i = 0; i < w; i++) {
+        uint32_t *d = dst + (ptrdiff_t)i * dst_stride;
+        for (int j = 0; j < h; j++) d[j] = src[(ptrdiff_t)j * src_stride + i];
+    }
+}
+
+static void reverse16_scalar(uint16_t *dst, const uint16_t *src, int n) {
+    for (int i = 0; i < n; i++) dst[i] = src[n - 1 - i];
+}
+
+static void reverse32_scalar(uint32_t *dst, const uint32_t *src, int n) {
+    for (int i = 0; i < n; i++) dst[i] = src[n - 1 - i];
+}
+
+// Four pixels make three little endian words
+static void pack24_scalar(uint8_t *dst, const uint32_t *src, int n) {
+    for (; n >= 4; n -= 4, src += 4, dst += 12) {
+        uint32_t w[3] = {
+            (src[0] & 0xFFFFFF) | (src[1] << 24),
+            ((src[1] >> 8) & 0xFFFF) | (src[2] << 16),
+            ((src[2] >> 16) & 0xFF) | (src[3] << 8)
+        };
+        memcpy(dst, w, sizeof(w));
+    }
+    for (; n > 0; n--, src++, dst += 3) {
+        dst[0] = (uint8_t)*src;
+        dst[1] = (uint8_t)(*src >> 8);
+        dst[2] = (uint8_t)(*src >> 16);
+    }
+}
+
+static const PixelKernels kernels_scalar = {
+    "scalar", fill16_scalar, fill32_scalar, glyph16_scalar, glyph32_scalar, copy_row_scalar,
+    fill8_scalar, glyph8_scalar, expand16_scalar, expand32_scalar,
+    scale16_scalar, scale32_scalar, remap16_scalar, remap32_scalar,
+    transpose16_scalar, transpose32_scalar, reverse16_scalar, reverse32_scalar,
+    pack24_scalar
+};
+
+// --- SSE2 / AVX2 (x86 hosts, for development and benchmarking) ---
+#ifdef KERNELS_X86
+
+__attribute__((target("sse2")))
+static void fill16_sse2(uint16_t *dst, uint16_t color, int n) {
+    __m128i c = _mm_set1_epi16((short)color);
+    for (; n >= 8; n -= 8, dst += 8) _mm_storeu_si128((__m128i*)dst, c);
+    while (n--) *dst++ = color;
+}
+
+__attribute__((target("sse2")))
+static void fill32_sse2(uint32_t *dst, uint32_t color, int n) {
+    __m128i c = _mm_set1_epi32((int)color);
+    for (; n >= 4; n -= 4, dst += 4) _mm_storeu_si128((__m128i*)dst, c);
+    while (n--) *dst++ = color;
+}
+
+__attribute__((target("sse2")))
+static void glyph16_sse2(uint16_t *dst, uint32_t bits, int n, uint16_t fore, uint16_t back, bool opaque) {
+    const __m128i lanes = _mm_setr_epi16(0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+    __m128i f = _mm_set1_epi16((short)fore);
+    __m128i b = _mm_set1_epi16((short)back);
+    for (; n >= 8; n -= 8, dst += 8, bits <<= 8) {
+        __m128i m = _mm_cmpeq_epi16(_mm_and_si128(_mm_set1_epi16((short)(bits >> 24)), lanes), lanes);
+        __m128i bg = opaque ? b : _mm_loadu_si128((const __m128i*)dst);
+        _mm_storeu_si128((__m128i*)dst, _mm_or_si128(_mm_and_si128(m, f), _mm_andnot_si128(m, bg)));
+    }
+    if (n > 0) glyph16_scalar(dst, bits, n, fore, back, opaque);
+}
+
+__attribute__((target("sse2")))
+static void glyph32_sse2(uint32_t *dst, uint32_t bits, int n, uint32_t fore, uint32_t back, bool opaque) {
+    const __m128i lanes = _mm_setr_epi32(0x8, 0x4, 0x2, 0x1);
+    __m128i f = _mm_set1_epi32((int)fore);
+    __m128i b = _mm_set1_epi32((int)back);
+    for (; n >= 4; n -= 4, dst += 4, bits <<= 4) {
+        __m128i m = _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32((int)(bits >> 28)), lanes), lanes);
+        __m128i bg = opaque ? b : _mm_loadu_si128((const __m128i*)dst);
+        _mm_storeu_si128((__m128i*)dst, _mm_or_si128(_mm_and_si128(m, f), _mm_andnot_si128(m, bg)));
+    }
+    if (n > 0) glyph32_scalar(dst, bits, n, fore, back, opaque);
+}
+
+__attribute__((target("sse2")))
+static void copy_row_sse2(void *dst, const void *src, size_t bytes) {
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+    for (; bytes >= 32; bytes -= 32, d += 32, s += 32) {
+        __m128i a = _mm_loadu_si128((const __m128i*)s);
+        __m128i b = _mm_loadu_si128((const __m128i*)(s + 16));
+        _mm_storeu_si128((__m128i*)d, a);
+        _mm_storeu_si128((__m128i*)(d + 16), b);
+    }
+    if (bytes) memcpy(d, s, bytes);
+}
+
+// Integer scaling by unpacking a vector with itself: 2x in one step, 4x in
+// two. Other factors take the scalar loop.
+__attribute__((target("sse2")))
+static void scale16_sse2(uint16_t *dst, const uint16_t *src, int n, int k) {
+    if (k == 2) {
+        for (; n >= 8; n -= 8, src += 8, dst += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)src);
+            _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi16(v, v));
+            _mm_storeu_si128((__m128i*)(dst + 8), _mm_unpackhi_epi16(v, v));
+        }
+    } else if (k == 4) {
+        for (; n >= 8; n -= 8, src += 8, dst += 32) {
+            __m128i v = _mm_loadu_si128((const __m128i*)src);
+            __m128i lo = _mm_unpacklo_epi16(v, v), hi = _mm_unpackhi_epi16(v, v);
+            _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi32(lo, lo));
+            _mm_storeu_si128((__m128i*)(dst + 8), _mm_unpackhi_epi32(lo, lo));
+            _mm_storeu_si128((__m128i*)(dst + 16), _mm_unpacklo_epi32(hi, hi));
+            _mm_storeu_si128((__m128i*)(dst + 24), _mm_unpackhi_epi32(hi, hi));
+        }
+    }
+    if (n > 0) scale16_scalar(dst, src, n, k);
+}
+
+__attribute__((target("sse2")))
+static void scale32_sse2(uint32_t *dst, const uint32_t *src, int n, int k) {
+    if (k == 2) {
+        for (; n >= 4; n -= 4, src += 4, dst += 8) {
+            __m128i v = _mm_loadu_si128((const __m128i*)src);
+            _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi32(v, v));
+            _mm_storeu_si128((__m128i*)(dst + 4), _mm_unpackhi_epi32(v, v));
+        }
+    } else if (k == 4) {
+        for (; n >= 4; n -= 4, src += 4, dst += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)src);
+            _mm_storeu_si128((__m128i*)dst, _mm_shuffle_epi32(v, 0x00));
+            _mm_storeu_si128((__m128i*)(dst + 4), _mm_shuffle_epi32(v, 0x55));
+            _mm_storeu_si128((__m128i*)(dst + 8), _mm_shuffle_epi32(v, 0xAA));
+            _mm_storeu_si128((__m128i*)(dst + 12), _mm_shuffle_epi32(v, 0xFF));
+        }
+    }
+    if (n > 0) scale32_scalar(dst, src, n, k);
+}
+
+// 8x8 (16 bpp) and 4x4 (32 bpp) in-register transposes via interleaves
+__attribute__((target("sse2")))
+static inline void transpose16_8x8_sse2(uint16_t *dst, int dst_stride, const uint16_t *src, int src_stride) {
+    __m128i r[8], t[8], u[8];
+    for (int k = 0; k < 8; k++) r[k] = _mm_loadu_si128((const __m128i*)(src + (ptrdiff_t)k * src_stride));
+    for (int k = 0; k < 8; k += 2) {
+        t[k] = _mm_unpacklo_epi16(r[k], r[k + 1]);     // columns 0-3 of two rows
+        t[k + 1] = _mm_unpackhi_epi16(r[k], r[k + 1]); // columns 4-7
+    }
+    for (int k = 0; k < 8; k += 4) {
+        u[k] = _mm_unpacklo_epi32(t[k], t[k + 2]);         // columns 0-1 of four rows
+        u[k + 1] = _mm_unpackhi_epi32(t[k], t[k + 2]);     // 2-3
+        u[k + 2] = _mm_unpacklo_epi32(t[k + 1], t[k + 3]); // 4-5
+        u[k + 3] = _mm_unpackhi_epi32(t[k + 1], t[k + 3]); // 6-7
+    }
+    for (int k = 0; k < 4; k++) {
+        _mm_storeu_si128((__m128i*)(dst + (ptrdiff_t)(2 * k) * dst_stride), _mm_unpacklo_epi64(u[k], u[k + 4]));
+        _mm_storeu_si128((__m128i*)(dst + (ptrdiff_t)(2 * k + 1) * dst_stride), _mm_unpackhi_epi64(u[k], u[k + 4]));
+    }
+}
+
+__attribute__((target("sse2")))
+static void transpose16_sse2(uint16_t *dst, int dst_stride, const uint16_t *src, int src_stride, int w, int h) {
+    TRANSPOSE_BLOCKS(8, transpose16_8x8_sse2, transpose16_scalar);
+}
+
+__attribute__((target("sse2")))
+static inline void transpose32_4x4_sse2(uint32_t *dst, int dst_stride, const uint32_t *src, int src_stride) {
+    __m128i r0 = _mm_loadu_si128((const __m128i*)src);
+    __m128i r1 = _mm_loadu_si128((const __m128i*)(src + src_stride));
+    __m128i r2 = _mm_loadu_si128((const __m128i*)(src + (ptrdiff_t)2 * src_stride));
+    __m128i r3 = _mm_loadu_si128((const __m128i*)(src + (ptrdiff_t)3 * src_stride));
+    __m128i t0 = _mm_unpacklo_epi32(r0, r1), t1 = _mm_unpackhi_epi32(r0, r1);
+    __m128i t2 = _mm_unpacklo_epi32(r2, r3), t3 = _mm_unpackhi_epi32(r2, r3);
+    _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi64(t0, t2));
+    _mm_storeu_si128((__m128i*)(dst + dst_stride), _mm_unpackhi_epi64(t0, t2));
+    _mm_storeu_si128((__m128i*)(dst + (ptrdiff_t)2 * dst_stride), _mm_unpacklo_epi64(t1, t3));
+    _mm_storeu_si128((__m128i*)(dst + (ptrdiff_t)3 * dst_stride), _mm_unpackhi_epi64(t1, t3));
+}
+
+__attribute__((target("sse2")))
+static void transpose32_sse2(uint32_t *dst, int dst_stride, const uint32_t *src, int src_stride, int w, int h) {
+    TRANSPOSE_BLOCKS(4, transpose32_4x4_sse2, transpose32_scalar);
+}
+
+__attribute__((target("sse2")))
+static void reverse16_sse2(uint16_t *dst, const uint16_t *src, int n) {
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + n - 8 - i));
+        v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0x1B), 0x1B);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_shuffle_epi32(v, 0x4E));
+    }
+    for (; i < n; i++) dst[i] = src[n - 1 - i];
+}
+
+__attribute__((target("sse2")))
+static void reverse32_sse2(uint32_t *dst, const uint32_t *src, int n) {
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + n - 4 - i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_shuffle_epi32(v, 0x1B));
+    }
+    for (; i < n; i++) dst[i] = src[n - 1 - i];
+}
+
+__attribute__((target("avx2")))
+static void fill16_avx2(uint16_t *dst, uint16_t color, int n) {
+    __m256i c = _mm256_set1_epi16((short)color);
+    for (; n >= 16; n -= 16, dst += 16) _mm256_storeu_si256((__m256i*)dst, c);
+    while (n--) *dst++ = color;
+}
+
+__attribute__((target("avx2")))
+static void fill32_avx2(uint32_t *dst, uint32_t color, int n) {
+    __m256i c = _mm256_set1_epi32((int)color);
+    for (; n >= 8; n -= 8, dst += 8) _mm256_storeu_si256((__m256i*)dst, c);
+    while (n--) *dst++ = color;
+}
+
+__attribute__((target("avx2")))
+static void glyph32_avx2(uint32_t *dst, uint32_t bits, int n, uint32_t fore, uint32_t back, bool opaque) {
+    const __m256i lanes = _mm256_setr_epi32(0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+    __m256i f = _mm256_set1_epi32((int)fore);
+    __m256i b = _mm256_set1_epi32((int)back);
+    for (; n >= 8; n -= 8, dst += 8, bits <<= 8) {
+        __m256i m = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32((int)(bits >> 24)), lanes), lanes);
+        __m256i bg = opaque ? b : _mm256_loadu_si256((const __m256i*)dst);
+        _mm256_storeu_si256((__m256i*)dst, _mm256_blendv_epi8(bg, f, m));
+    }
+    if (n > 0) glyph32_sse2(dst, bits, n, fore, back, opaque);
+}
+
+// Palette lookups are gathers, which only AVX2 has. 16 bpp entries are
+// gathered as 32-bit words and narrowed with a pack.
+__attribute__((target("avx2")))
+static void expand32_avx2(uint32_t *dst, const uint8_t *src, int n, const uint32_t *lut) {
+    for (; n >= 8; n -= 8, dst += 8, src += 8) {
+        __m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)src));
+        _mm256_storeu_si256((__m256i*)dst, _mm256_i32gather_epi32((const int*)lut, idx, 4));
+    }
+    if (n > 0) expand32_scalar(dst, src, n, lut);
+}
+
+__attribute__((target("avx2")))
+static void expand16_avx2(uint16_t *dst, const uint8_t *src, int n, const uint32_t *lut) {
+    for (; n >= 16; n -= 16, dst += 16, src += 16) {
+        __m256i a = _mm256_i32gather_epi32((const int*)lut, _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)src)), 4);
+        __m256i b = _mm256_i32gather_epi32((const int*)lut, _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + 8))), 4);
+        // packus works per 128-bit lane, restore the order afterwards
+        __m256i p = _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), 0xD8);
+        _mm256_storeu_si256((__m256i*)dst, p);
+    }
+    if (n > 0) expand16_scalar(dst, src, n, lut);
+}
+
+// Any factor up to 4: output vector 'v' of a group takes source lanes
+// (v * 8 + lane) / k of the 8 loaded pixels.
+__attribute__((target("avx2")))
+static void scale32_avx2(uint32_t *dst, const uint32_t *src, int n, int k) {
+    if (k < 2 || k > 4) {
+        scale32_scalar(dst, src, n, k);
+        return;
+    }
+    __m256i idx[4];
+    for (int v = 0; v < k; v++) {
+        int lanes[8];
+        for (int j = 0; j < 8; j++) lanes[j] = (v * 8 + j) / k;
+        idx[v] = _mm256_loadu_si256((const __m256i*)lanes);
+    }
+    for (; n >= 8; n -= 8, src += 8, dst += 8 * k) {
+        __m256i s = _mm256_loadu_si256((const __m256i*)src);
+        for (int v = 0; v < k; v++) {
+            _mm256_storeu_si256((__m256i*)(dst + v * 8), _mm256_permutevar8x32_epi32(s, idx[v]));
+        }
+    }
+    if (n > 0) scale32_scalar(dst, src, n, k);
+}
+
+__attribute__((target("avx2")))
+static void remap32_avx2(uint32_t *dst, const uint32_t *src, const int *map, int n) {
+    for (; n >= 8; n -= 8, dst += 8, map += 8) {
+        __m256i idx = _mm256_loadu_si256((const __m256i*)map);
+        _mm256_storeu_si256((__m256i*)dst, _mm256_i32gather_epi32((const int*)src, idx, 4));
+    }
+    if (n > 0) remap32_scalar(dst, src, map, n);
+}
+
+__attribute__((target("avx2")))
+static void copy_row_avx2(void *dst, const void *src, size_t bytes) {
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+    for (; bytes >= 64; bytes -= 64, d += 64, s += 64) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)s);
+        __m256i b = _mm256_loadu_si256((const __m256i*)(s + 32));
+        _mm256_storeu_si256((__m256i*)d, a);
+        _mm256_storeu_si256((__m256i*)(d + 32), b);
+    }
+    if (bytes) memcpy(d, s, bytes);
+}
+
+// Each lane drops the top byte of its 4 pixels, then the two 12-byte halves
+// are moved next to each other. Stores are exactly 24 bytes, the span may end
+// right before pixels that must not be touched.
+__attribute__((target("avx2")))
+static void pack24_avx2(uint8_t *dst, const uint32_t *src, int n) {
+    const __m256i squeeze = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                             0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    const __m256i join = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    for (; n >= 8; n -= 8, src += 8, dst += 24) {
+        __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)src), squeeze);
+        v = _mm256_permutevar8x32_epi32(v, join);
+        _mm_storeu_si128((__m128i*)dst, _mm256_castsi256_si128(v));
+        _mm_storel_epi64((__m128i*)(dst + 16), _mm256_extracti128_si256(v, 1));
+    }
+    if (n > 0) pack24_scalar(dst, src, n);
+}
+
+static const PixelKernels kernels_sse2 = {
+    "sse2", fill16_sse2, fill32_sse2, glyph16_sse2, glyph32_sse2, copy_row_sse2,
+    fill8_scalar, glyph8_scalar, expand16_scalar, expand32_scalar,
+    scale16_sse2, scale32_sse2, remap16_scalar, remap32_scalar,
+    transpose16_sse2, transpose32_sse2, reverse16_sse2, reverse32_sse2,
+    pack24_scalar
+};
+
+// 16 bpp glyph rows are at most 16 pixels, one SSE2 vector already covers 8.
+// 16 bpp remaps stay scalar: a 32-bit gather could read past the last pixel.
+static const PixelKernels kernels_avx2 = {
+    "avx2", fill16_avx2, fill32_avx2, glyph16_sse2, glyph32_avx2, copy_row_avx2,
+    fill8_scalar, glyph8_scalar, expand16_avx2, expand32_avx2,
+    scale16_sse2, scale32_avx2, remap16_scalar, remap32_avx2,
+    transpose16_sse2, transpose32_sse2, reverse16_sse2, reverse32_sse2,
+    pack24_avx2
+};
+
+#endif
+
+// --- NEON (built from kernels_neon.c, see there) ---
+#ifdef KERNELS_NEON
+
+static PixelKernels kernels_neon;
+
+static bool cpu_has_neon(void) {
+#if defined(__aarch64__)
+    return true;
+#else
+    return (getauxval(AT_HWCAP) & HWCAP_NEON) != 0;
+#endif
+}
+
+#endif
+
+// --- Dispatch ---
+
+int kernels_available(const PixelKernels **list, int max) {
+    int n = 0;
+    if (n < max) list[n++] = &kernels_scalar;
+#ifdef KERNELS_X86
+    __builtin_cpu_init();
+    if (n < max && __builtin_cpu_supports("sse2")) list[n++] = &kernels_sse2;
+    if (n < max && __builtin_cpu_supports("avx2")) list[n++] = &kernels_avx2;
+#endif
+#ifdef KERNELS_NEON
+    if (n < max && cpu_has_neon()) {
+        kernels_neon = kernels_scalar;
+        kernels_neon_setup(&kernels_neon);
+        list[n++] = &kernels_neon;
+    }
+#endif
+    return n;
+}
+
+void kernels_init(const char *name) {
+    init_nibble_masks();
+
+    const PixelKernels *list[4];
+    int n = kernels_available(list, 4);
+
+    // Sets are listed in ascending preference, the last one is the best
+    const PixelKernels *pick = list[n - 1];
+    if (name && *name && strcmp(name, "auto") != 0) {
+        bool found = false;
+        for (int i = 0; i < n; i++) {
+            if (strcmp(list[i]->name, name) == 0) { pick = list[i]; found = true; }
+        }
+        if (!found) fprintf(stderr, "Kernels: '%s' not supported here, using %s\n", name, pick->name);
+    }
+    kern = *pick;
+    printf("Kernels: %s\n", kern.name);
+}
@@ -0,0 +1,72 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Pixel kernels used by the display hot loops. Every CPU gets the scalar
+// set; SSE2/AVX2 (x86 hosts) and NEON (ARMv7 with -mfpu=neon, AArch64) are
+// picked at startup from the features the CPU reports.
+//
+// Glyph kernels take up to 32 mask bits left-aligned in 'bits' (MSB = first
+// pixel). Clear bits write 'back' when opaque, or keep the pixel otherwise.
+typedef struct {
+    const char *name;
+    void (*fill16)(uint16_t *dst, uint16_t color, int n);
+    void (*fill32)(uint32_t *dst, uint32_t color, int n);
+    void (*glyph16)(uint16_t *dst, uint32_t bits, int n, uint16_t fore, uint16_t back, bool opaque);
+    void (*glyph32)(uint32_t *dst, uint32_t bits, int n, uint32_t fore, uint32_t back, bool opaque);
+    void (*copy_row)(void *dst, const void *src, size_t bytes);
+    // Palette-indexed render buffer support
+    void (*fill8)(uint8_t *dst, uint8_t index, int n);
+    void (*glyph8)(uint8_t *dst, uint32_t bits, int n, uint8_t fore, uint8_t back, bool opaque);
+    void (*expand16)(uint16_t *dst, const uint8_t *src, int n, const uint32_t *lut);
+    void (*expand32)(uint32_t *dst, const uint8_t *src, int n, const uint32_t *lut);
+    // Scaled output: repeat each of 'n' pixels 'k' times, or pick 'n' pixels
+    // through a column map
+    void (*scale16)(uint16_t *dst, const uint16_t *src, int n, int k);
+    void (*scale32)(uint32_t *dst, const uint32_t *src, int n, int k);
+    void (*remap16)(uint16_t *dst, const uint16_t *src, const int *map, int n);
+    void (*remap32)(uint32_t *dst, const uint32_t *src, const int *map, int n);
+    // Rotation: row i of a w x h block at 'dst' gets column i of 'src'.
+    // Strides are in pixels and may be negative to mirror the block.
+    void (*transpose16)(uint16_t *dst, int dst_stride, const uint16_t *src, int src_stride, int w, int h);
+    void (*transpose32)(uint32_t *dst, int dst_stride, const uint32_t *src, int src_stride, int w, int h);
+    // Write 'n' pixels back to front (180 degree rotation)
+    void (*reverse16)(uint16_t *dst, const uint16_t *src, int n);
+    void (*reverse32)(uint32_t *dst, const uint32_t *src, int n);
+    // 24 bpp output: store the low 3 bytes of each of 'n' 32-bit pixels
+    void (*pack24)(uint8_t *dst, const uint32_t *src, int n);
+} PixelKernels;
+
+// Active kernel set, valid after kernels_init()
+extern PixelKernels kern;
+
+// Select the kernel set: "auto" (or NULL) for the best supported one, or a
+// name from kernels_available() to force it. Unknown names fall back to auto.
+void kernels_init(const char *name);
+
+// All kernel sets this CPU supports, scalar first
+int kernels_available(const PixelKernels **list, int max);
+
+// --- Shared by the SIMD sets ---
+
+// NEON set (kernels_neon.c): replaces the entries of 'k', a copy of the
+// scalar set, that it accelerates
+void kernels_neon_setup(PixelKernels *k);
+
+// SIMD transposes work on square sub-blocks; the ragged right and bottom
+// edges of a block go through the scalar loop.
+#define TRANSPOSE_BLOCKS(B, block, scalar) do { \
+    int w_b = w - w % (B), h_b = h - h % (B); \
+    for (int i = 0; i < w_b; i += (B)) { \
+        for (int j = 0; j < h_b; j += (B)) { \
+            block(dst + (ptrdiff_t)i * dst_stride + j, dst_stride, src + (ptrdiff_t)j * src_stride + i, src_stride); \
+        } \
+    } \
+    if (h_b < h) scalar(dst + h_b, dst_stride, src + (ptrdiff_t)h_b * src_stride, src_stride, w_b, h - h_b); \
+    if (w_b < w) scalar(dst + (ptrdiff_t)w_b * dst_stride, dst_stride, src + w_b, src_stride, w - w_b, h); \
+} while (0)
+
+#endif
@@ -0,0 +1,198 @@
+#include "kernels.h"
+#include <string.h>
+
+// The NEON kernels, the only code built with NEON enabled on ARMv7
+// (ARM_NEON=1 adds -mfpu=neon-vfpv4 for this file alone). Everything else
+// stays on the base FPU, so a board without NEON never executes NEON
+// instructions before kernels_available() has checked the CPU.
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(__aarch64__)
+#include <arm_neon.h>
+
+// Tails and unaccelerated entries fall back to the scalar set
+static PixelKernels scalar;
+
+static void fill16_neon(uint16_t *dst, uint16_t color, int n) {
+    uint16x8_t c = vdupq_n_u16(color);
+    for (; n >= 16; n -= 16, dst += 16) { vst1q_u16(dst, c); vst1q_u16(dst + 8, c); }
+    for (; n >= 8; n -= 8, dst += 8) vst1q_u16(dst, c);
+    while (n--) *dst++ = color;
+}
+
+static void fill32_neon(uint32_t *dst, uint32_t color, int n) {
+    uint32x4_t c = vdupq_n_u32(color);
+    for (; n >= 8; n -= 8, dst += 8) { vst1q_u32(dst, c); vst1q_u32(dst + 4, c); }
+    for (; n >= 4; n -= 4, dst += 4) vst1q_u32(dst, c);
+    while (n--) *dst++ = color;
+}
+
+static void glyph16_neon(uint16_t *dst, uint32_t bits, int n, uint16_t fore, uint16_t back, bool opaque) {
+    static const uint16_t lane_bits[8] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
+    const uint16x8_t lanes = vld1q_u16(lane_bits);
+    uint16x8_t f = vdupq_n_u16(fore);
+    uint16x8_t b = vdupq_n_u16(back);
+    for (; n >= 8; n -= 8, dst += 8, bits <<= 8) {
+        uint16x8_t m = vtstq_u16(vdupq_n_u16((uint16_t)(bits >> 24)), lanes);
+        uint16x8_t bg = opaque ? b : vld1q_u16(dst);
+        vst1q_u16(dst, vbslq_u16(m, f, bg));
+    }
+    if (n > 0) scalar.glyph16(dst, bits, n, fore, back, opaque);
+}
+
+static void glyph32_neon(uint32_t *dst, uint32_t bits, int n, uint32_t fore, uint32_t back, bool opaque) {
+    static const uint32_t lane_bits[4] = { 0x8, 0x4, 0x2, 0x1 };
+    const uint32x4_t lanes = vld1q_u32(lane_bits);
+    uint32x4_t f = vdupq_n_u32(fore);
+    uint32x4_t b = vdupq_n_u32(back);
+    for (; n >= 4; n -= 4, dst += 4, bits <<= 4) {
+        uint32x4_t m = vtstq_u32(vdupq_n_u32(bits >> 28), lanes);
+        uint32x4_t bg = opaque ? b : vld1q_u32(dst);
+        vst1q_u32(dst, vbslq_u32(m, f, bg));
+    }
+    if (n > 0) scalar.glyph32(dst, bits, n, fore, back, opaque);
+}
+
+static void copy_row_neon(void *dst, const void *src, size_t bytes) {
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+    for (; bytes >= 64; bytes -= 64, d += 64, s += 64) {
+        uint8x16_t a = vld1q_u8(s), b = vld1q_u8(s + 16);
+        uint8x16_t c = vld1q_u8(s + 32), e = vld1q_u8(s + 48);
+        vst1q_u8(d, a); vst1q_u8(d + 16, b);
+        vst1q_u8(d + 32, c); vst1q_u8(d + 48, e);
+    }
+    if (bytes) memcpy(d, s, bytes);
+}
+
+// Interleaving stores of the same register repeat every pixel 2, 3 or 4 times
+static void scale16_neon(uint16_t *dst, const uint16_t *src, int n, int k) {
+    if (k == 2) {
+        for (; n >= 8; n -= 8, src += 8, dst += 16) {
+            uint16x8_t v = vld1q_u16(src);
+            uint16x8x2_t o = { { v, v } };
+            vst2q_u16(dst, o);
+        }
+    } else if (k == 3) {
+        for (; n >= 8; n -= 8, src += 8, dst += 24) {
+            uint16x8_t v = vld1q_u16(src);
+            uint16x8x3_t o = { { v, v, v } };
+            vst3q_u16(dst, o);
+        }
+    } else if (k == 4) {
+        for (; n >= 8; n -= 8, src += 8, dst += 32) {
+            uint16x8_t v = vld1q_u16(src);
+            uint16x8x4_t o = { { v, v, v, v } };
+            vst4q_u16(dst, o);
+        }
+    }
+    if (n > 0) scalar.scale16(dst, src, n, k);
+}
+
+static void scale32_neon(uint32_t *dst, const uint32_t *src, int n, int k) {
+    if (k == 2) {
+        for (; n >= 4; n -= 4, src += 4, dst += 8) {
+            uint32x4_t v = vld1q_u32(src);
+            uint32x4x2_t o = { { v, v } };
+            vst2q_u32(dst, o);
+        }
+    } else if (k == 3) {
+        for (; n >= 4; n -= 4, src += 4, dst += 12) {
+            uint32x4_t v = vld1q_u32(src);
+            uint32x4x3_t o = { { v, v, v } };
+            vst3q_u32(dst, o);
+        }
+    } else if (k == 4) {
+        for (; n >= 4; n -= 4, src += 4, dst += 16) {
+            uint32x4_t v = vld1q_u32(src);
+            uint32x4x4_t o = { { v, v, v, v } };
+            vst4q_u32(dst, o);
+        }
+    }
+    if (n > 0) scalar.scale32(dst, src, n, k);
+}
+
+// 8x8 (16 bpp) and 4x4 (32 bpp) in-register transposes via vtrn
+static inline void transpose16_8x8_neon(uint16_t *dst, int dst_stride, const uint16_t *src, int src_stride) {
+    uint16x8_t r[8];
+    for (int k = 0; k < 8; k++) r[k] = vld1q_u16(src + (ptrdiff_t)k * src_stride);
+    // Pairs of rows: val[0] holds even columns, val[1] odd columns
+    uint16x8x2_t a0 = vtrnq_u16(r[0], r[1]), a1 = vtrnq_u16(r[2], r[3]);
+    uint16x8x2_t a2 = vtrnq_u16(r[4], r[5]), a3 = vtrnq_u16(r[6], r[7]);
+    // Quads of rows: columns {0,4} / {2,6} and {1,5} / {3,7}
+    uint32x4x2_t b0 = vtrnq_u32(vreinterpretq_u32_u16(a0.val[0]), vreinterpretq_u32_u16(a1.val[0]));
+    uint32x4x2_t b1 = vtrnq_u32(vreinterpretq_u32_u16(a0.val[1]), vreinterpretq_u32_u16(a1.val[1]));
+    uint32x4x2_t b2 = vtrnq_u32(vreinterpretq_u32_u16(a2.val[0]), vreinterpretq_u32_u16(a3.val[0]));
+    uint32x4x2_t b3 = vtrnq_u32(vreinterpretq_u32_u16(a2.val[1]), vreinterpretq_u32_u16(a3.val[1]));
+    uint32x4_t lo[4] = { b0.val[0], b1.val[0], b0.val[1], b1.val[1] }; // rows 0-3, columns 0-3 (+4)
+    uint32x4_t hi[4] = { b2.val[0], b3.val[0], b2.val[1], b3.val[1] }; // rows 4-7
+    for (int k = 0; k < 4; k++) {
+        vst1q_u16(dst + (ptrdiff_t)k * dst_stride,
+                  vreinterpretq_u16_u32(vcombine_u32(vget_low_u32(lo[k]), vget_low_u32(hi[k]))));
+        vst1q_u16(dst + (ptrdiff_t)(k + 4) * dst_stride,
+                  vreinterpretq_u16_u32(vcombine_u32(vget_high_u32(lo[k]), vget_high_u32(hi[k]))));
+    }
+}
+
+static void transpose16_neon(uint16_t *dst, int dst_stride, const uint16_t *src, int src_stride, int w, int h) {
+    TRANSPOSE_BLOCKS(8, transpose16_8x8_neon, scalar.transpose16);
+}
+
+static inline void transpose32_4x4_neon(uint32_t *dst, int dst_stride, const uint32_t *src, int src_stride) {
+    uint32x4x2_t t0 = vtrnq_u32(vld1q_u32(src), vld1q_u32(src + src_stride));
+    uint32x4x2_t t1 = vtrnq_u32(vld1q_u32(src + (ptrdiff_t)2 * src_stride), vld1q_u32(src + (ptrdiff_t)3 * src_stride));
+    vst1q_u32(dst, vcombine_u32(vget_low_u32(t0.val[0]), vget_low_u32(t1.val[0])));
+    vst1q_u32(dst + dst_stride, vcombine_u32(vget_low_u32(t0.val[1]), vget_low_u32(t1.val[1])));
+    vst1q_u32(dst + (ptrdiff_t)2 * dst_stride, vcombine_u32(vget_high_u32(t0.val[0]), vget_high_u32(t1.val[0])));
+    vst1q_u32(dst + (ptrdiff_t)3 * dst_stride, vcombine_u32(vget_high_u32(t0.val[1]), vget_high_u32(t1.val[1])));
+}
+
+static void transpose32_neon(uint32_t *dst, int dst_stride, const uint32_t *src, int src_stride, int w, int h) {
+    TRANSPOSE_BLOCKS(4, transpose32_4x4_neon, scalar.transpose32);
+}
+
+static void reverse16_neon(uint16_t *dst, const uint16_t *src, int n) {
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint16x8_t v = vrev64q_u16(vld1q_u16(src + n - 8 - i));
+        vst1q_u16(dst + i, vcombine_u16(vget_high_u16(v), vget_low_u16(v)));
+    }
+    for (; i < n; i++) dst[i] = src[n - 1 - i];
+}
+
+static void reverse32_neon(uint32_t *dst, const uint32_t *src, int n) {
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        uint32x4_t v = vrev64q_u32(vld1q_u32(src + n - 4 - i));
+        vst1q_u32(dst + i, vcombine_u32(vget_high_u32(v), vget_low_u32(v)));
+    }
+    for (; i < n; i++) dst[i] = src[n - 1 - i];
+}
+
+// De-interleave 16 pixels into byte planes and store three of them back
+static void pack24_neon(uint8_t *dst, const uint32_t *src, int n) {
+    for (; n >= 16; n -= 16, src += 16, dst += 48) {
+        uint8x16x4_t v = vld4q_u8((const uint8_t*)src);
+        uint8x16x3_t o = { { v.val[0], v.val[1], v.val[2] } };
+        vst3q_u8(dst, o);
+    }
+    if (n > 0) scalar.pack24(dst, src, n);
+}
+
+// NEON has no gather, palette expansion and remaps stay on the scalar loops
+void kernels_neon_setup(PixelKernels *k) {
+    scalar = *k;
+    k->name = "neon";
+    k->fill16 = fill16_neon;
+    k->fill32 = fill32_neon;
+    k->glyph16 = glyph16_neon;
+    k->glyph32 = glyph32_neon;
+    k->copy_row = copy_row_neon;
+    k->scale16 = scale16_neon;
+    k->scale32 = scale32_neon;
+    k->transpose16 = transpose16_neon;
+    k->transpose32 = transpose32_neon;
+    k->reverse16 = reverse16_neon;
+    k->reverse32 = reverse32_neon;
+    k->pack24 = pack24_neon;
+}
+
+#endif
@@ -3,6 +3,8 @@
 #include <string.h>
 #include <unistd.h>
 #include <poll.h>
+#include <time.h>
+#include <signal.h>
 
 #include "common.h"
 #include "ini.h"
@@ -10,10 +12,28 @@
 #include "input.h"
 #include "serial.h"
 #include "audio.h"
+#include "bench.h"
+#include "frame.h"
+#include "record.h"
+#include "replay.h"
 
 Config app_config;
 bool g_dirty = false;
 
+static volatile sig_atomic_t cycle_blit_mode = 0;
+static volatile sig_atomic_t quit = 0;
+
+static void on_sigusr1(int sig) {
+    (void)sig;
+    cycle_blit_mode = 1;
+}
+
+// Leave the main loop so a recording is flushed and the display restored
+static void on_quit(int sig) {
+    (void)sig;
+    quit = 1;
+}
+
 static int config_get_int(ini_t *ini, const char *section, const char *key, int default_val) {
     const char *str = ini_get(ini, section, key);
     if (str) return atoi(str);
@@ -42,6 +62,32 @@ void load_configuration(const char* filename) {
     app_config.key_map[5] = 57;  // START
     app_config.key_map[6] = 29;  // OPT
     app_config.key_map[7] = 56;  // EDIT
+    app_config.stats_interval = 0;
+    app_config.rotation = 0;
+    app_config.serial_read_size = 4096;
+    app_config.serial_read_budget = 16384;
+    app_config.serial_thread = 0;
+    app_config.serial_queue_kb = 256;
+    app_config.record_file[0] = '\0';
+    app_config.record_buffer_kb = 1024;
+    app_config.blit_mode = BLIT_COPY;
+    app_config.page_flip = 0;
+    app_config.vsync_pacing = 1;
+    app_config.vsync_hz = 60;
+    strcpy(app_config.kernels, "auto");
+    app_config.indexed = 0;
+    strcpy(app_config.scale, "1");
+    app_config.video_mode[0] = '\0';
+    strcpy(app_config.backend, "fbdev");
+    strcpy(app_config.drm_path, "/dev/dri/card0");
+    app_config.offscreen_path[0] = '\0';
+    app_config.offscreen_bpp = 16;
+    app_config.offscreen_line_length = 0;
+    app_config.draw_batch = 0;
+    app_config.frame_gap_ms = 2;
+    app_config.frame_deadline_ms = 20;
+    app_config.frame_on_waveform = 1;
+    strcpy(app_config.direct_render, "auto");
 
     // Audio Defaults
     audio_config.enabled = 0;
@@ -56,6 +102,33 @@ void load_configuration(const char* filename) {
     config_get_str(ini, "system", "serial_device", app_config.serial_path, 64);
     config_get_str(ini, "system", "framebuffer_device", app_config.fb_path, 64);
     config_get_str(ini, "system", "input_device", app_config.input_path, 64);
+    app_config.stats_interval = config_get_int(ini, "system", "stats_interval", app_config.stats_interval);
+    app_config.rotation = config_get_int(ini, "system", "rotation", app_config.rotation);
+    app_config.serial_read_size = config_get_int(ini, "system", "serial_read_size", app_config.serial_read_size);
+    app_config.serial_read_budget = config_get_int(ini, "system", "serial_read_budget", app_config.serial_read_budget);
+    app_config.serial_thread = config_get_int(ini, "system", "serial_thread", app_config.serial_thread);
+    app_config.serial_queue_kb = config_get_int(ini, "system", "serial_queue_kb", app_config.serial_queue_kb);
+    config_get_str(ini, "system", "record_file", app_config.record_file, sizeof(app_config.record_file));
+    app_config.record_buffer_kb = config_get_int(ini, "system", "record_buffer_kb", app_config.record_buffer_kb);
+
+    app_config.blit_mode = config_get_int(ini, "display", "blit_mode", app_config.blit_mode);
+    app_config.page_flip = config_get_int(ini, "display", "page_flip", app_config.page_flip);
+    app_config.vsync_pacing = config_get_int(ini, "display", "vsync_pacing", app_config.vsync_pacing);
+    app_config.vsync_hz = config_get_int(ini, "display", "vsync_hz", app_config.vsync_hz);
+    config_get_str(ini, "display", "kernels", app_config.kernels, sizeof(app_config.kernels));
+    app_config.indexed = config_get_int(ini, "display", "indexed", app_config.indexed);
+    config_get_str(ini, "display", "scale", app_config.scale, sizeof(app_config.scale));
+    config_get_str(ini, "display", "video_mode", app_config.video_mode, sizeof(app_config.video_mode));
+    config_get_str(ini, "display", "backend", app_config.backend, sizeof(app_config.backend));
+    config_get_str(ini, "display", "drm_device", app_config.drm_path, sizeof(app_config.drm_path));
+    config_get_str(ini, "display", "offscreen_file", app_config.offscreen_path, sizeof(app_config.offscreen_path));
+    app_config.offscreen_bpp = config_get_int(ini, "display", "offscreen_bpp", app_config.offscreen_bpp);
+    app_config.offscreen_line_length = config_get_int(ini, "display", "offscreen_line_length", app_config.offscreen_line_length);
+    app_config.draw_batch = config_get_int(ini, "display", "draw_batch", app_config.draw_batch);
+    app_config.frame_gap_ms = config_get_int(ini, "display", "frame_gap_ms", app_config.frame_gap_ms);
+    app_config.frame_deadline_ms = config_get_int(ini, "display", "frame_deadline_ms", app_config.frame_deadline_ms);
+    app_config.frame_on_waveform = config_get_int(ini, "display", "frame_on_waveform", app_config.frame_on_waveform);
+    config_get_str(ini, "display", "direct_render", app_config.direct_render, sizeof(app_config.direct_render));
 
     const char* names[] = {"key_up","key_down","key_left","key_right","key_select","key_start","key_opt","key_edit"};
     for(int i=0; i<8; i++) {
@@ -71,10 +144,31 @@ void load_configuration(const char* filename) {
     ini_free(ini);
 }
 
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
 int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) return bench_run();
+
     load_configuration("config.ini");
+    const char* replay_path = NULL;
+    double replay_speed = 1;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--record") == 0) {
+            snprintf(app_config.record_file, sizeof(app_config.record_file), "%s", argv[i + 1]);
+        } else if (strcmp(argv[i], "--replay") == 0) {
+            replay_path = argv[i + 1];
+        } else if (strcmp(argv[i], "--speed") == 0) {
+            replay_speed = (strcmp(argv[i + 1], "max") == 0) ? 0 : atof(argv[i + 1]);
+        }
+    }
+    if (replay_path) return replay_run(replay_path, replay_speed);
 
     display_init();
+    frame_init(app_config.frame_gap_ms, app_config.frame_deadline_ms, app_config.frame_on_waveform);
     input_init();
     serial_init();
 
@@ -82,8 +176,16 @@ int main(int argc, char** argv) {
         audio_start_thread();
     }
 
-    struct pollfd fds[2]; 
-    while (1) {
+    if (app_config.record_file[0] && !record_start(app_config.record_file, app_config.record_buffer_kb)) exit(1);
+
+    signal(SIGUSR1, on_sigusr1);
+    signal(SIGINT, on_quit);
+    signal(SIGTERM, on_quit);
+
+    struct pollfd fds[3]; 
+    bool vblank = true;
+    double next_stats = monotonic_seconds() + app_config.stats_interval;
+    while (!quit) {
         if (!serial_is_connected()) {
             serial_connect();
             if (!serial_is_connected()) usleep(500000); 
@@ -92,25 +194,61 @@ int main(int argc, char** argv) {
         int nfds = 0;
         int ser_fd = serial_get_fd();
         int inp_fd = input_get_fd();
+        int vs_fd = display_get_vsync_fd();
+        int ser_idx = -1, inp_idx = -1, vs_idx = -1;
 
-        if (ser_fd != -1) { fds[nfds].fd = ser_fd; fds[nfds].events = POLLIN; nfds++; }
-        if (inp_fd != -1) { fds[nfds].fd = inp_fd; fds[nfds].events = POLLIN; nfds++; }
+        if (ser_fd != -1) { ser_idx = nfds; fds[nfds].fd = ser_fd; fds[nfds].events = POLLIN; nfds++; }
+        if (inp_fd != -1) { inp_idx = nfds; fds[nfds].fd = inp_fd; fds[nfds].events = POLLIN; nfds++; }
+        if (vs_fd != -1) { vs_idx = nfds; fds[nfds].fd = vs_fd; fds[nfds].events = POLLIN; nfds++; }
 
         if (nfds == 0) { usleep(10000); continue; }
 
-        int ret = poll(fds, nfds, 10); 
+        // Without vsync pacing, blits happen as soon as a frame is complete and
+        // display_blit() waits for the vblank itself. With pacing, a vblank
+        // that finds a frame still arriving is kept until it is complete.
+        if (vs_fd == -1) vblank = true;
+
+        // Wake up when the frame being assembled times out by itself
+        int timeout = g_dirty ? frame_timeout_ms(10) : 10;
+        int ret = poll(fds, nfds, timeout); 
         if (ret > 0) {
-            if (ser_fd != -1 && (fds[0].revents & POLLIN)) serial_read();
-            int inp_idx = (ser_fd != -1) ? 1 : 0;
-            if (inp_fd != -1 && inp_idx < nfds && (fds[inp_idx].revents & POLLIN)) input_process();
+            if (ser_idx >= 0 && (fds[ser_idx].revents & POLLIN)) serial_read();
+            if (inp_idx >= 0 && (fds[inp_idx].revents & POLLIN)) input_process();
+            if (vs_idx >= 0 && (fds[vs_idx].revents & POLLIN) && display_vsync_ack()) vblank = true;
         }
 
-        if (g_dirty) {
+        if (cycle_blit_mode) {
+            cycle_blit_mode = 0;
+            static const char* mode_names[] = {"copy", "diff", "pages"};
+            BlitMode old = display_get_blit_mode();
+            BlitMode mode = (old + 1) % BLIT_MODE_COUNT;
+            display_set_blit_mode(mode);
+            BlitMode applied = display_get_blit_mode();
+            if (applied != mode) printf("Blit mode: %s, cycling unavailable with direct rendering\n", mode_names[applied]);
+            else printf("Blit mode: %s\n", mode_names[applied]);
+            if (applied != old) g_dirty = true;
+        }
+
+        if (g_dirty && vblank && frame_complete()) {
             display_blit();
+            frame_presented();
             g_dirty = false;
+            vblank = false;
+        } else if (!g_dirty) {
+            vblank = false;
+        }
+
+        if (app_config.stats_interval > 0 && monotonic_seconds() >= next_stats) {
+            display_print_stats();
+            frame_print_stats();
+            serial_print_stats();
+            record_print_stats();
+            next_stats += app_config.stats_interval;
         }
     }
 
+    serial_close();
+    record_stop();
     display_close();
     return 0;
 }
@@ -0,0 +1,84 @@
+#define _GNU_SOURCE
+#include "offscreen.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+int offscreen_open(const char *path, const char *mode, int bpp, int line_length, bool two_pages,
+                   struct fb_var_screeninfo *vinfo, struct fb_fix_screeninfo *finfo) {
+    int w = 320, h = 240;
+    if (*mode && (sscanf(mode, "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0)) {
+        fprintf(stderr, "Offscreen: bad mode '%s'\n", mode);
+        return -1;
+    }
+    if (bpp != 16 && bpp != 24 && bpp != 32) {
+        fprintf(stderr, "Offscreen: %d bpp not supported, using 16\n", bpp);
+        bpp = 16;
+    }
+    if (line_length < w * bpp / 8) line_length = w * bpp / 8;
+
+    int fd = *path ? open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)
+                   : memfd_create("m8alt-fb", MFD_CLOEXEC);
+    if (fd == -1) {
+        fprintf(stderr, "Offscreen: cannot create %s\n", *path ? path : "memfd");
+        return -1;
+    }
+
+    int pages = two_pages ? 2 : 1;
+    if (ftruncate(fd, (off_t)line_length * h * pages) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    memset(vinfo, 0, sizeof(*vinfo));
+    memset(finfo, 0, sizeof(*finfo));
+    vinfo->xres = vinfo->xres_virtual = w;
+    vinfo->yres = h;
+    vinfo->yres_virtual = h * pages;
+    vinfo->bits_per_pixel = bpp;
+    if (bpp >= 24) {
+        vinfo->red = (struct fb_bitfield){ 16, 8, 0 };
+        vinfo->green = (struct fb_bitfield){ 8, 8, 0 };
+        vinfo->blue = (struct fb_bitfield){ 0, 8, 0 };
+        if (bpp == 32) vinfo->transp = (struct fb_bitfield){ 24, 8, 0 };
+    } else {
+        vinfo->red = (struct fb_bitfield){ 11, 5, 0 };
+        vinfo->green = (struct fb_bitfield){ 5, 6, 0 };
+        vinfo->blue = (struct fb_bitfield){ 0, 5, 0 };
+    }
+    strcpy(finfo->id, "offscreen");
+    finfo->line_length = line_length;
+    finfo->smem_len = line_length * h * pages;
+    finfo->visual = FB_VISUAL_TRUECOLOR;
+
+    printf("Offscreen: %dx%d %d bpp, line_length %d, %d page(s) in %s\n",
+           w, h, bpp, line_length, pages, *path ? path : "memfd");
+    return fd;
+}
+
+void offscreen_wait_vsync(int hz) {
+    static struct timespec epoch;
+    if (hz <= 0) hz = 60;
+    if (epoch.tv_sec == 0 && epoch.tv_nsec == 0) clock_gettime(CLOCK_MONOTONIC, &epoch);
+
+    // Vblanks fall on a fixed grid from the first call, like a real display
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t period = 1000000000LL / hz;
+    int64_t elapsed = (now.tv_sec - epoch.tv_sec) * 1000000000LL + (now.tv_nsec - epoch.tv_nsec);
+    int64_t next = (elapsed / period + 1) * period;
+
+    struct timespec wake = epoch;
+    wake.tv_sec += next / 1000000000LL;
+    wake.tv_nsec += next % 1000000000LL;
+    if (wake.tv_nsec >= 1000000000L) {
+        wake.tv_sec++;
+        wake.tv_nsec -= 1000000000L;
+    }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) == EINTR) {}
+}
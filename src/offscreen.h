@@ -0,0 +1,21 @@
+#ifndef OFFSCREEN_H
+#define OFFSCREEN_H
+
+#include <stdbool.h>
+#include <linux/fb.h>
+
+// Headless framebuffer for profiling the render path on hosts without a
+// display. A memfd (or a regular file, so frames can be inspected from
+// outside) is sized and described like an fbdev device; the display code
+// maps it and runs its normal fbdev path with the ioctls left out.
+
+// Create the buffer: 'mode' is "WxH" ("" = 320x240), 'bpp' 16 or 32,
+// 'line_length' 0 for packed rows. 'path' "" uses an anonymous memfd.
+// Fills vinfo/finfo like FBIOGET_*SCREENINFO and returns the fd, or -1.
+int offscreen_open(const char *path, const char *mode, int bpp, int line_length, bool two_pages,
+                   struct fb_var_screeninfo *vinfo, struct fb_fix_screeninfo *finfo);
+
+// Sleep until the next simulated vblank of a 'hz' display
+void offscreen_wait_vsync(int hz);
+
+#endif
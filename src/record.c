@@ -0,0 +1,158 @@
+#include "record.h"
+#include "spsc.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define WRITER_PERIOD_US 20000
+
+static FILE* rec_file = NULL;
+static char rec_path[128];
+static SpscRing rec_ring;
+static atomic_bool rec_on = false;
+static atomic_bool rec_running = false;
+static pthread_t rec_thread;
+static pthread_mutex_t rec_lock = PTHREAD_MUTEX_INITIALIZER; // Serializes producers
+static uint64_t rec_start_ns;
+static bool rec_failed = false;
+
+static _Atomic uint64_t st_chunks;   // Chunks written to the file
+static _Atomic uint64_t st_dropped;  // Ring full, or discarded after a write error
+static _Atomic uint64_t st_written;  // Bytes written to the file
+
+static uint64_t clock_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void write_failed(void) {
+    if (rec_failed) return;
+    fprintf(stderr, "Record: write to %s failed, recording stopped\n", rec_path);
+    rec_failed = true;
+    rec_on = false; // Producers stop queueing chunks nobody writes
+}
+
+// Ring records are already laid out as file chunks, so they are written as is.
+// They only count as written once the flush has reached the file.
+static void flush_ring(void) {
+    uint8_t *rec;
+    uint32_t size;
+    uint64_t chunks = 0, bytes = 0;
+    while ((size = spsc_peek(&rec_ring, &rec)) > 0) {
+        if (!rec_failed && fwrite(rec, 1, size, rec_file) == size) {
+            chunks++;
+            bytes += size;
+        } else {
+            write_failed();
+            st_dropped++;
+        }
+        spsc_pop(&rec_ring);
+    }
+    if (chunks == 0) return;
+    // Keep the file current, a killed process loses at most one period
+    if (!rec_failed && fflush(rec_file) == 0) {
+        st_chunks += chunks;
+        st_written += bytes;
+    } else {
+        write_failed();
+        st_dropped += chunks;
+    }
+}
+
+static void* writer_thread_fn(void* arg) {
+    (void)arg;
+    while (rec_running) {
+        flush_ring();
+        usleep(WRITER_PERIOD_US);
+    }
+    flush_ring();
+    return NULL;
+}
+
+bool record_start(const char* path, int buffer_kb) {
+    if (rec_file) return true;
+    rec_file = fopen(path, "wb");
+    if (!rec_file) {
+        fprintf(stderr, "Record: cannot create %s\n", path);
+        return false;
+    }
+    if (!spsc_init(&rec_ring, (buffer_kb > 0 ? buffer_kb : 1024) * 1024)) {
+        fclose(rec_file);
+        rec_file = NULL;
+        return false;
+    }
+    snprintf(rec_path, sizeof(rec_path), "%s", path);
+
+    uint8_t header[RECORD_HEADER_SIZE] = {0};
+    uint32_t version = RECORD_VERSION;
+    uint64_t wall = clock_ns(CLOCK_REALTIME);
+    memcpy(header, RECORD_MAGIC, 8);
+    memcpy(header + 8, &version, 4);
+    memcpy(header + 16, &wall, 8);
+    fwrite(header, 1, sizeof(header), rec_file);
+    st_written = sizeof(header);
+    rec_failed = false;
+
+    rec_start_ns = clock_ns(CLOCK_MONOTONIC);
+    rec_running = true;
+    if (pthread_create(&rec_thread, NULL, writer_thread_fn, NULL) != 0) {
+        rec_running = false;
+        fclose(rec_file);
+        rec_file = NULL;
+        spsc_free(&rec_ring);
+        fprintf(stderr, "Record: cannot start writer thread\n");
+        return false;
+    }
+    rec_on = true;
+    printf("Recording serial stream to %s\n", path);
+    return true;
+}
+
+void record_stop(void) {
+    // rec_on is already false if a write failed, but the writer still runs
+    if (!rec_file) return;
+    rec_on = false;
+    // Let a producer that already passed the rec_on check finish its push
+    pthread_mutex_lock(&rec_lock);
+    pthread_mutex_unlock(&rec_lock);
+    rec_running = false;
+    pthread_join(rec_thread, NULL);
+    fclose(rec_file);
+    rec_file = NULL;
+    spsc_free(&rec_ring);
+    printf("Recording %s %s: %llu chunks, %llu KB, %llu dropped\n",
+           rec_failed ? "stopped by a write error, partly saved to" : "saved to", rec_path,
+           (unsigned long long)st_chunks, (unsigned long long)(st_written / 1024),
+           (unsigned long long)st_dropped);
+}
+
+bool record_active(void) {
+    return rec_on;
+}
+
+void record_chunk(bool tx, const uint8_t* data, uint32_t size) {
+    if (!rec_on || size == 0) return;
+    uint8_t header[RECORD_CHUNK_HEADER_SIZE];
+    uint32_t len = size | (tx ? RECORD_TX : 0);
+    memcpy(header + 8, &len, 4);
+
+    pthread_mutex_lock(&rec_lock);
+    if (rec_on) {
+        // Stamped under the lock, so TX and RX chunks reach the file in time order
+        uint64_t t = clock_ns(CLOCK_MONOTONIC) - rec_start_ns;
+        memcpy(header, &t, 8);
+        if (!spsc_push2(&rec_ring, header, sizeof(header), data, size)) st_dropped++;
+    }
+    pthread_mutex_unlock(&rec_lock);
+}
+
+void record_print_stats(void) {
+    if (!rec_on) return;
+    printf("Record: %llu chunks, %llu KB written, %llu dropped\n",
+           (unsigned long long)st_chunks, (unsigned long long)(st_written / 1024),
+           (unsigned long long)st_dropped);
+}
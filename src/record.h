@@ -0,0 +1,33 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Capture of the raw M8 serial stream. Every chunk read from the port and
+// every byte written to it is stored with a monotonic timestamp; a background
+// thread does the file I/O so recording never blocks the reader.
+//
+// File layout, little-endian:
+//   header: "M8SERREC", uint32 version, uint32 reserved, uint64 wall clock
+//           at the start (ns since the epoch)
+//   chunks: uint64 ns since the start, uint32 length (| RECORD_TX for bytes
+//           sent to the M8), then the bytes as they appeared on the wire
+#define RECORD_MAGIC "M8SERREC"
+#define RECORD_VERSION 1
+#define RECORD_HEADER_SIZE 24
+#define RECORD_CHUNK_HEADER_SIZE 12
+#define RECORD_TX 0x80000000u
+
+// 'buffer_kb' of memory absorbs slow storage; chunks that do not fit are
+// dropped and counted. Returns false if the file cannot be created.
+bool record_start(const char* path, int buffer_kb);
+void record_stop(void);
+bool record_active(void);
+
+// Safe to call from the serial reader thread and the main loop at once
+void record_chunk(bool tx, const uint8_t* data, uint32_t size);
+
+void record_print_stats(void);
+
+#endif
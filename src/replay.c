@@ -0,0 +1,275 @@
+#include "replay.h"
+#include "common.h"
+#include "display.h"
+#include "frame.h"
+#include "record.h"
+#include "serial.h"
+#include "slip.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint8_t rp_rx[1024];
+
+// Per command type, indexed by the command byte. Decoding is the time spent
+// in the command processor minus any rasterising done inside it (all of it
+// without draw_batch); rasterising itself is timed by the display.
+static uint64_t cmd_count[256];
+static uint64_t cmd_ns[256];
+static uint64_t chunk_cmd_ns;   // Command time within the current chunk
+static uint64_t chunk_cmds;
+static uint64_t frame_cmd_ns;   // Command time since the last blit
+static uint64_t clock_cost_ns;  // One now_ns() call, taken off every measurement
+
+// Per frame: blit time, and blit plus the commands that made up the frame
+static uint32_t *blit_ns, *frame_ns;
+static size_t frames, frames_cap;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t raster_total_ns(uint64_t *count) {
+    const DisplayStats* ds = display_get_stats();
+    uint64_t ns = 0;
+    *count = 0;
+    for (int t = 0; t < DRAW_TYPE_COUNT; t++) {
+        ns += ds->raster_ns[t];
+        *count += ds->raster_count[t];
+    }
+    return ns;
+}
+
+static int timed_command(uint8_t *data, uint32_t size) {
+    if (size == 0) return 0;
+    uint64_t rasters0, rasters1;
+    uint64_t raster0 = raster_total_ns(&rasters0);
+    uint64_t t0 = now_ns();
+    int ret = serial_process_command(data, size);
+    uint64_t ns = now_ns() - t0;
+    ns = (ns > clock_cost_ns) ? ns - clock_cost_ns : 0;
+    uint64_t raster = raster_total_ns(&rasters1) - raster0 + (rasters1 - rasters0) * clock_cost_ns;
+    cmd_count[data[0]]++;
+    cmd_ns[data[0]] += (ns > raster) ? ns - raster : 0;
+    chunk_cmd_ns += ns;
+    chunk_cmds++;
+    frame_cmd_ns += ns;
+    return ret;
+}
+
+static void present(void) {
+    uint64_t blits = display_get_stats()->blits;
+    uint64_t t0 = now_ns();
+    display_blit();
+    uint64_t ns = now_ns() - t0;
+    frame_presented();
+    g_dirty = false;
+    uint64_t cmd_ns = frame_cmd_ns;
+    frame_cmd_ns = 0;
+    // Frames that changed nothing on screen are not worth a sample
+    if (display_get_stats()->blits == blits) return;
+
+    if (frames == frames_cap) {
+        frames_cap = frames_cap ? frames_cap * 2 : 4096;
+        blit_ns = realloc(blit_ns, frames_cap * sizeof(*blit_ns));
+        frame_ns = realloc(frame_ns, frames_cap * sizeof(*frame_ns));
+        if (!blit_ns || !frame_ns) exit(1);
+    }
+    blit_ns[frames] = (uint32_t)ns;
+    frame_ns[frames] = (uint32_t)(ns + cmd_ns);
+    frames++;
+}
+
+// Real-time modes: sleep until the chunk is due, blitting frames as the frame
+// assembler completes them, like the main loop does between poll() wakeups
+static void wait_until(uint64_t due) {
+    while (1) {
+        if (g_dirty && frame_complete()) present();
+        uint64_t now = now_ns();
+        if (now >= due) return;
+        uint64_t wait = due - now;
+        uint64_t max_wait = (uint64_t)(g_dirty ? frame_timeout_ms(10) : 10) * 1000000ull;
+        if (wait > max_wait) wait = max_wait;
+        struct timespec ts = { (time_t)(wait / 1000000000ull), (long)(wait % 1000000000ull) };
+        nanosleep(&ts, NULL);
+    }
+}
+
+// Timing every command costs two clock reads, which on some boards is as
+// slow as the command itself
+static void calibrate_clock(void) {
+    clock_cost_ns = UINT64_MAX;
+    for (int pass = 0; pass < 10; pass++) {
+        uint64_t t0 = now_ns();
+        for (int i = 0; i < 1000; i++) now_ns();
+        uint64_t cost = (now_ns() - t0) / 1001;
+        if (cost < clock_cost_ns) clock_cost_ns = cost;
+    }
+}
+
+static int cmp_u32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void print_percentiles(const char* name, uint32_t *v, size_t n) {
+    qsort(v, n, sizeof(*v), cmp_u32);
+    printf("%-24s%12.1f%12.1f%12.1f\n", name, v[n / 2] / 1e3, v[(n - 1) * 99 / 100] / 1e3, v[n - 1] / 1e3);
+}
+
+static uint8_t* load_capture(const char* path, size_t *size) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "Replay: cannot open %s\n", path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = (len > 0) ? malloc(len) : NULL;
+    if (!data || fread(data, 1, len, f) != (size_t)len) {
+        fprintf(stderr, "Replay: cannot read %s\n", path);
+        free(data);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+
+    uint32_t version = 0;
+    if (len >= RECORD_HEADER_SIZE) memcpy(&version, data + 8, 4);
+    if (len < RECORD_HEADER_SIZE || memcmp(data, RECORD_MAGIC, 8) != 0 || version != RECORD_VERSION) {
+        fprintf(stderr, "Replay: %s is not a version %d serial capture\n", path, RECORD_VERSION);
+        free(data);
+        return NULL;
+    }
+    *size = len;
+    return data;
+}
+
+int replay_run(const char* path, double speed) {
+    size_t size;
+    uint8_t *data = load_capture(path, &size);
+    if (!data) return 1;
+
+    // Time the rendering, not the wait for a vblank: display_blit() leaves
+    // vsync to the main loop when paced, and replay blits whenever a frame
+    // is complete
+    app_config.vsync_pacing = 1;
+    display_init();
+    display_set_raster_timing(true);
+    frame_init(app_config.frame_gap_ms, app_config.frame_deadline_ms, app_config.frame_on_waveform);
+
+    static const slip_descriptor_s desc = { rp_rx, sizeof(rp_rx), timed_command };
+    slip_handler_s slip;
+    slip_init(&slip, &desc);
+    calibrate_clock();
+
+    if (speed > 0) printf("Replaying %s at %.2fx recorded speed\n", path, speed);
+    else printf("Replaying %s at full speed\n", path);
+
+    uint64_t rx_bytes = 0, tx_chunks = 0, decode_ns = 0, last_t = 0;
+    uint64_t gap_ns = (uint64_t)app_config.frame_gap_ms * 1000000ull;
+    uint64_t start = now_ns();
+    size_t pos = RECORD_HEADER_SIZE;
+    while (pos + RECORD_CHUNK_HEADER_SIZE <= size) {
+        uint64_t t;
+        uint32_t len;
+        memcpy(&t, data + pos, 8);
+        memcpy(&len, data + pos + 8, 4);
+        bool tx = len & RECORD_TX;
+        len &= ~RECORD_TX;
+        pos += RECORD_CHUNK_HEADER_SIZE;
+        if (len > size - pos) {
+            printf("Replay: capture truncated, stopping at the last whole chunk\n");
+            break;
+        }
+        uint8_t *chunk = data + pos;
+        pos += len;
+        if (tx) {
+            tx_chunks++;
+            continue;
+        }
+
+        if (speed > 0) {
+            wait_until(start + (uint64_t)(t / speed));
+        } else if (g_dirty && (frame_complete() || t - last_t >= gap_ns)) {
+            // No real idle gaps at full speed: use the recorded ones
+            present();
+        }
+        last_t = t;
+
+        frame_data_received();
+        chunk_cmd_ns = chunk_cmds = 0;
+        uint64_t t0 = now_ns();
+        slip_read_buffer(&slip, chunk, len);
+        uint64_t ns = now_ns() - t0;
+        // Each command's clock reads fall outside its own measurement
+        uint64_t overhead = chunk_cmd_ns + (2 * chunk_cmds + 1) * clock_cost_ns;
+        decode_ns += (ns > overhead) ? ns - overhead : 0;
+        rx_bytes += len;
+    }
+    if (g_dirty) present();
+    double wall = (now_ns() - start) / 1e9;
+
+    uint64_t commands = 0, cmd_total_ns = 0;
+    for (int c = 0; c < 256; c++) {
+        commands += cmd_count[c];
+        cmd_total_ns += cmd_ns[c];
+    }
+    printf("\nReplay: %llu commands from %llu KB in %.2f s (%llu sent chunks skipped)\n",
+           (unsigned long long)commands, (unsigned long long)(rx_bytes / 1024), wall,
+           (unsigned long long)tx_chunks);
+    printf("Replay: SLIP decode %.1f MB/s, %.0f ns per command\n",
+           decode_ns ? rx_bytes / (decode_ns / 1e9) / (1024 * 1024) : 0.0,
+           commands ? (double)decode_ns / commands : 0.0);
+
+    // Rasterised counts can be lower: draw_batch culls overdrawn commands
+    // and merges rects
+    const DisplayStats* ds = display_get_stats();
+    static const struct { uint8_t cmd; int draw; const char* name; } names[] = {
+        { 0xFE, DRAW_RECT, "draw rect" }, { 0xFD, DRAW_CHAR, "draw char" },
+        { 0xFC, DRAW_WAVE, "waveform" }, { 0xFF, -1, "system info" }
+    };
+    printf("\n%-24s%12s%12s%12s%12s%12s\n", "command", "count", "decode ns", "rasterised", "raster ns", "total ms");
+    uint64_t other = commands, other_ns = cmd_total_ns;
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        uint64_t n = cmd_count[names[i].cmd];
+        other -= n;
+        other_ns -= cmd_ns[names[i].cmd];
+        if (!n) continue;
+        uint64_t rn = 0, rns = 0;
+        if (names[i].draw >= 0) {
+            rn = ds->raster_count[names[i].draw];
+            rns = ds->raster_ns[names[i].draw];
+            rns = (rns > rn * clock_cost_ns) ? rns - rn * clock_cost_ns : 0;
+        }
+        printf("%-24s%12llu%12.0f%12llu%12.0f%12.1f\n", names[i].name, (unsigned long long)n,
+               (double)cmd_ns[names[i].cmd] / n, (unsigned long long)rn, rn ? (double)rns / rn : 0.0,
+               (cmd_ns[names[i].cmd] + rns) / 1e6);
+    }
+    if (other) {
+        printf("%-24s%12llu%12.0f%12s%12s%12.1f\n", "other", (unsigned long long)other,
+               (double)other_ns / other, "-", "-", other_ns / 1e6);
+    }
+
+    printf("\nReplay: %llu blits, %llu dirty pixels (%llu per blit)\n",
+           (unsigned long long)ds->blits, (unsigned long long)ds->pixels_dirty,
+           (unsigned long long)(ds->blits ? ds->pixels_dirty / ds->blits : 0));
+    if (frames) {
+        printf("\n%-24s%12s%12s%12s\n", "frame time (us)", "p50", "p99", "max");
+        print_percentiles("blit", blit_ns, frames);
+        print_percentiles("commands + blit", frame_ns, frames);
+    }
+    printf("\n");
+    display_print_stats();
+    frame_print_stats();
+
+    display_close();
+    free(blit_ns);
+    free(frame_ns);
+    free(data);
+    return 0;
+}
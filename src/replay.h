@@ -0,0 +1,12 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+// Drive the render pipeline from a --record capture, without an M8:
+//   ./m8alt --replay capture.bin [--speed <factor>|max]
+// The received bytes go through the SLIP decoder, the command processor and
+// the display backend from config.ini (backend=offscreen needs no screen).
+// 'speed' 1 keeps the recorded timing, 2 plays twice as fast, 0 as fast as
+// possible. Prints per-command and per-frame timings at the end.
+int replay_run(const char* path, double speed);
+
+#endif
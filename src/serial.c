@@ -2,17 +2,52 @@
 #include "common.h"
 #include "display.h"
 #include "slip.h"
+#include "frame.h"
+#include "spsc.h"
+#include "record.h"
 #include <stdio.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <stdlib.h>
 #include <termios.h>
 #include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include <linux/serial.h>
 
 static int ser_fd = -1;
 static bool ser_connected = false;
 static uint8_t rx_buffer[1024];
 static slip_handler_s slip;
 
+// Raw bytes of one read(), decoded right away by slip_read_buffer()
+static uint8_t *rx_read;
+static int rx_read_size;
+
+// Optional reader thread (serial_thread=1): it owns ser_fd and the SLIP
+// decoder and queues decoded commands; the main loop polls rd_event_fd
+static bool rd_threaded = false;
+static atomic_bool rd_running = false;
+static atomic_bool rd_lost = false;    // Read error, the port is gone
+static bool rd_pending = false;        // Commands queued since the last signal
+static pthread_t rd_thread;
+static int rd_event_fd = -1;
+static SpscRing rd_queue;
+
+// Updated by whichever thread reads the port, printed by the main loop
+static _Atomic uint64_t st_wakeups;     // Wakeups that got data
+static _Atomic uint64_t st_reads;
+static _Atomic uint64_t st_bytes;
+static _Atomic uint64_t st_budget_hits; // Wakeups cut short by serial_read_budget
+static _Atomic int st_peak_backlog;     // Most bytes waiting in the tty at a wakeup
+static _Atomic uint64_t st_queue_full;  // Reader found the queue full and waited
+static _Atomic uint64_t st_dropped;     // Commands lost because it stayed full
+static uint64_t st_queued;              // Commands taken from the queue
+static uint32_t st_queue_peak;          // Most queued bytes at a wakeup
+
 // M8 "Running Status" - Persist color between commands
 static uint8_t last_r = 255;
 static uint8_t last_g = 255;
@@ -31,6 +66,13 @@ static int process_command(uint8_t *data, uint32_t size) {
     
     uint8_t cmd = data[0];
 
+    // Frames can be handled in place, straight from the read buffer, so one
+    // shorter than its command's fixed fields must not be read past its end
+    if ((cmd == CMD_DRAW_RECT && size < 5) || (cmd == CMD_DRAW_CHAR && size < 12) ||
+        (cmd == CMD_DRAW_WAVE && size < 4) || (cmd == CMD_SYSTEM_INFO && size < 6)) {
+        return 0;
+    }
+
     if (cmd == CMD_DRAW_RECT) {
         uint16_t x = data[1] | (data[2] << 8);
         uint16_t y = data[3] | (data[4] << 8);
@@ -68,6 +110,7 @@ static int process_command(uint8_t *data, uint32_t size) {
         // If size == 5, w/h are 1, and we use last_r/g/b
         
         display_draw_rect(x, y, w, h, r, g, b);
+        frame_add_command(false);
         g_dirty = true;
     }
     else if (cmd == CMD_DRAW_CHAR) {
@@ -75,6 +118,7 @@ static int process_command(uint8_t *data, uint32_t size) {
         uint16_t x = data[2] | (data[3] << 8);
         uint16_t y = data[4] | (data[5] << 8);
         display_draw_char(c, x, y, data[6], data[7], data[8], data[9], data[10], data[11]);
+        frame_add_command(false);
         g_dirty = true;
     }
     else if (cmd == CMD_DRAW_WAVE) {
@@ -82,23 +126,177 @@ static int process_command(uint8_t *data, uint32_t size) {
         uint8_t g = data[2];
         uint8_t b = data[3];
         display_draw_waveform(r, g, b, &data[4], size - 4);
+        frame_add_command(true);
         g_dirty = true;
     }
     else if (cmd == CMD_SYSTEM_INFO) {
         int hw = data[1]; // 3 = Model:02
         int font_mode = data[5];
         if(hw == 3) font_mode += 2;
+        // Model:02 has a 480x320 screen
+        if (hw == 3) display_set_geometry(480, 320);
+        else display_set_geometry(320, 240);
         display_set_font(font_mode);
+        g_dirty = true;
     }
     return 1;
 }
 
-static int recv_msg_cb(uint8_t *data, uint32_t size) {
+int serial_process_command(uint8_t *data, uint32_t size) {
     return process_command(data, size);
 }
 
+// Reader thread side. When the render loop falls behind, wait for it rather
+// than lose commands, but not forever: a reader that stops reading lets the
+// tty overrun, which corrupts frames instead of dropping whole commands.
+static int queue_command(uint8_t *data, uint32_t size) {
+    if (size == 0) return 0;
+    int waited_ms = 0;
+    while (!spsc_push(&rd_queue, data, size)) {
+        if (waited_ms == 0) {
+            st_queue_full++;
+            uint64_t one = 1;
+            if (write(rd_event_fd, &one, sizeof(one)) < 0) { /* Already signalled */ }
+        }
+        if (waited_ms >= 100 || !rd_running) {
+            st_dropped++;
+            return 0;
+        }
+        usleep(1000);
+        waited_ms++;
+    }
+    rd_pending = true;
+    return 1;
+}
+
+static int recv_msg_cb(uint8_t *data, uint32_t size) {
+    return rd_threaded ? queue_command(data, size) : process_command(data, size);
+}
+
+// One wakeup drains everything the tty has queued instead of a single read,
+// so a full-screen redraw no longer takes dozens of poll/blit rounds. A short
+// read means the port is empty and saves the read that would return EAGAIN.
+// A 'budget' bounds one wakeup; the rest of the data wakes poll() again right
+// away. Returns false when the port is gone.
+static bool drain_port(int budget) {
+    if (app_config.stats_interval > 0) {
+        int queued = 0;
+        if (ioctl(ser_fd, FIONREAD, &queued) == 0 && queued > st_peak_backlog) st_peak_backlog = queued;
+    }
+
+    bool ok = true;
+    int total = 0;
+    while (1) {
+        int n = read(ser_fd, rx_read, rx_read_size);
+        if (n < 0 && errno == EINTR) continue;
+        // An empty non-blocking port reports EAGAIN, so 0 means a hangup. A
+        // short read does not mean empty: n_tty returns at most 4095 bytes per
+        // read() while its flip buffers may hold more.
+        if (n == 0 || (n < 0 && errno != EAGAIN)) ok = false;
+        if (n <= 0) break;
+
+        if (total == 0) {
+            if (!rd_threaded) frame_data_received();
+            st_wakeups++;
+        }
+        st_reads++;
+        total += n;
+        record_chunk(false, rx_read, n);
+        slip_read_buffer(&slip, rx_read, n);
+        // Let the render loop start on these while the next chunk is read
+        if (rd_pending) {
+            uint64_t one = 1;
+            if (write(rd_event_fd, &one, sizeof(one)) < 0) { /* Already signalled */ }
+            rd_pending = false;
+        }
+        if (budget > 0 && total >= budget) {
+            st_budget_hits++;
+            break;
+        }
+    }
+    st_bytes += total;
+    return ok;
+}
+
+static void* reader_thread_fn(void* arg) {
+    (void)arg;
+    struct pollfd pfd = { .fd = ser_fd, .events = POLLIN };
+    while (rd_running) {
+        // Time out now and then to notice serial_close()
+        if (poll(&pfd, 1, 100) <= 0) continue;
+        if (!drain_port(0)) {
+            rd_lost = true;
+            uint64_t one = 1;
+            if (write(rd_event_fd, &one, sizeof(one)) < 0) { /* Already signalled */ }
+            break;
+        }
+    }
+    return NULL;
+}
+
+static void start_reader(void) {
+    rd_lost = false;
+    rd_pending = false;
+    spsc_reset(&rd_queue);
+    rd_running = true;
+    rd_threaded = true;
+    if (pthread_create(&rd_thread, NULL, reader_thread_fn, NULL) != 0) {
+        rd_running = false;
+        rd_threaded = false;
+        printf("Serial: cannot start reader thread, reading on the main loop\n");
+    }
+}
+
+static void stop_reader(void) {
+    if (!rd_threaded) return;
+    rd_running = false;
+    pthread_join(rd_thread, NULL);
+    rd_threaded = false;
+    uint64_t ticks;
+    if (read(rd_event_fd, &ticks, sizeof(ticks)) < 0) { /* Nothing pending */ }
+}
+
+// Main loop side: run the queued commands. The byte budget applies here too,
+// re-signalling the eventfd so the rest is picked up on the next wakeup.
+static void drain_queue(void) {
+    uint64_t ticks;
+    if (read(rd_event_fd, &ticks, sizeof(ticks)) < 0) { /* Spurious wakeup */ }
+
+    uint32_t used = spsc_used(&rd_queue);
+    if (used > st_queue_peak) st_queue_peak = used;
+    if (used) frame_data_received();
+
+    int budget = app_config.serial_read_budget;
+    int total = 0;
+    uint8_t *msg;
+    uint32_t size;
+    while ((size = spsc_peek(&rd_queue, &msg)) > 0) {
+        process_command(msg, size);
+        spsc_pop(&rd_queue);
+        st_queued++;
+        total += size;
+        if (budget > 0 && total >= budget) {
+            uint64_t one = 1;
+            if (write(rd_event_fd, &one, sizeof(one)) < 0) { /* Already signalled */ }
+            break;
+        }
+    }
+
+    if (rd_lost && spsc_used(&rd_queue) == 0) {
+        serial_close();
+        printf("M8 Disconnected\n");
+    }
+}
+
 // --- Public Interface ---
 
+// Everything sent to the M8 goes through here so a recording has it too
+static int port_write(const void* data, int size) {
+    int n = write(ser_fd, data, size);
+    if (n > 0) record_chunk(true, data, n);
+    return n;
+}
+
 void serial_init(void) {
     ser_fd = -1;
     ser_connected = false;
@@ -108,6 +306,18 @@ void serial_init(void) {
         .recv_message = recv_msg_cb
     };
     slip_init(&slip, &slip_desc);
+
+    rx_read_size = (app_config.serial_read_size >= 256) ? app_config.serial_read_size : 256;
+    rx_read = malloc(rx_read_size);
+    if (!rx_read) exit(1);
+
+    if (app_config.serial_thread) {
+        rd_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (rd_event_fd == -1 || !spsc_init(&rd_queue, app_config.serial_queue_kb * 1024)) {
+            printf("Serial: cannot set up the reader thread queue, reading on the main loop\n");
+            app_config.serial_thread = 0;
+        }
+    }
 }
 
 void serial_connect(void) {
@@ -116,7 +326,8 @@ void serial_connect(void) {
     ser_fd = open(app_config.serial_path, O_RDWR | O_NOCTTY | O_NDELAY);
     if (ser_fd == -1) return;
     
-    fcntl(ser_fd, F_SETFL, 0);
+    // Non-blocking, serial_read() drains the port until it would block
+    fcntl(ser_fd, F_SETFL, O_NONBLOCK);
 
     struct termios options;
     tcgetattr(ser_fd, &options);
@@ -128,14 +339,17 @@ void serial_connect(void) {
     printf("M8 Connected on %s\n", app_config.serial_path);
     
     // Handshake
-    write(ser_fd, "D", 1);
+    port_write("D", 1);
     usleep(20000);
-    write(ser_fd, "E", 1);
+    port_write("E", 1);
     usleep(20000);
-    write(ser_fd, "R", 1);
+    port_write("R", 1);
+
+    if (app_config.serial_thread) start_reader();
 }
 
 void serial_close(void) {
+    stop_reader();
     if (ser_fd != -1) close(ser_fd);
     ser_connected = false;
     ser_fd = -1;
@@ -143,11 +357,9 @@ void serial_close(void) {
 
 void serial_read(void) {
     if (!ser_connected) return;
-    uint8_t buf[256];
-    int n = read(ser_fd, buf, sizeof(buf));
-    if (n > 0) {
-        for (int i = 0; i < n; i++) slip_read_byte(&slip, buf[i]);
-    } else if (n < 0 && errno != EAGAIN) {
+    if (rd_threaded) {
+        drain_queue();
+    } else if (!drain_port(app_config.serial_read_budget)) {
         serial_close();
         printf("M8 Disconnected\n");
     }
@@ -156,16 +368,33 @@ void serial_read(void) {
 void serial_send_input(uint8_t val) {
     if (!ser_connected) return;
     uint8_t buf[2] = {'C', val};
-    if (write(ser_fd, buf, 2) < 0) {
+    if (port_write(buf, 2) < 0 && errno != EAGAIN) {
         serial_close();
         printf("M8 Disconnected (Write fail)\n");
     }
 }
 
+// The main loop polls the queue's eventfd while the reader thread runs
 int serial_get_fd(void) {
-    return ser_fd;
+    return rd_threaded ? rd_event_fd : ser_fd;
 }
 
 bool serial_is_connected(void) {
     return ser_connected;
+}
+
+void serial_print_stats(void) {
+    if (st_wakeups == 0) return;
+    printf("Serial: %llu B/wakeup, %.2f reads/wakeup, peak backlog %d B, budget hit %llu times",
+           (unsigned long long)(st_bytes / st_wakeups), (double)st_reads / st_wakeups,
+           st_peak_backlog, (unsigned long long)st_budget_hits);
+    // Bytes the tty layer dropped, if the driver counts them
+    struct serial_icounter_struct ic;
+    if (ser_fd != -1 && ioctl(ser_fd, TIOCGICOUNT, &ic) == 0) printf(", %d overruns", ic.overrun + ic.buf_overrun);
+    printf("\n");
+    if (app_config.serial_thread) {
+        printf("Serial queue: peak %u/%u B, %llu commands, full %llu times, %llu dropped\n",
+               st_queue_peak, rd_queue.size, (unsigned long long)st_queued,
+               (unsigned long long)st_queue_full, (unsigned long long)st_dropped);
+    }
 }
\ No newline at end of file
@@ -11,5 +11,9 @@ bool serial_is_connected(void);
 void serial_read(void);
 void serial_send_input(uint8_t val);
 void serial_close(void);
+void serial_print_stats(void);
+
+// Execute one SLIP-decoded M8 command; --replay runs its own decoder
+int serial_process_command(uint8_t *data, uint32_t size);
 
 #endif
\ No newline at end of file
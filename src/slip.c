@@ -30,6 +30,7 @@ program. */
 
 #include <assert.h>
 #include <stddef.h>
+#include <string.h>
 
 static void reset_rx(slip_handler_s *slip) {
   assert(slip != NULL);
@@ -112,3 +113,82 @@ slip_error_t slip_read_byte(slip_handler_s *slip, uint8_t byte) {
 
   return error;
 }
+
+/* First END or ESC byte in [p, end), or end. A byte of v ^ pattern is zero
+exactly where v matches, and (x - 0x01..) & ~x & 0x80.. is non-zero iff x has
+a zero byte, so eight bytes are ruled out per step. */
+static uint8_t *find_special(uint8_t *p, const uint8_t *end) {
+  const uint64_t ones = 0x0101010101010101ull;
+  const uint64_t highs = 0x8080808080808080ull;
+  const uint64_t end_pattern = ones * SLIP_SPECIAL_BYTE_END;
+  const uint64_t esc_pattern = ones * SLIP_SPECIAL_BYTE_ESC;
+
+  while (end - p >= 8) {
+    uint64_t v, a, b;
+    memcpy(&v, p, sizeof(v));
+    a = v ^ end_pattern;
+    b = v ^ esc_pattern;
+    if (((a - ones) & ~a & highs) | ((b - ones) & ~b & highs))
+      break;
+    p += 8;
+  }
+  while (p < end && *p != SLIP_SPECIAL_BYTE_END && *p != SLIP_SPECIAL_BYTE_ESC)
+    p++;
+  return p;
+}
+
+/* Append a run of plain bytes. A run that would overflow the buffer takes the
+byte path, which drops and restarts exactly like before. */
+static slip_error_t put_run_to_buffer(slip_handler_s *slip, const uint8_t *run, uint32_t size) {
+  slip_error_t error = SLIP_NO_ERROR;
+
+  if (slip->size + size <= slip->descriptor->buf_size) {
+    memcpy(slip->descriptor->buf + slip->size, run, size);
+    slip->size += size;
+    return SLIP_NO_ERROR;
+  }
+  for (uint32_t i = 0; i < size; i++) {
+    slip_error_t e = put_byte_to_buffer(slip, run[i]);
+    if (error == SLIP_NO_ERROR)
+      error = e;
+  }
+  return error;
+}
+
+slip_error_t slip_read_buffer(slip_handler_s *slip, uint8_t *data, uint32_t size) {
+  slip_error_t error = SLIP_NO_ERROR, e;
+  uint8_t *p = data;
+  const uint8_t *end = data + size;
+
+  assert(slip != NULL);
+
+  while (p < end) {
+    if (slip->state == SLIP_STATE_ESCAPED) {
+      e = slip_read_byte(slip, *p++);
+      if (error == SLIP_NO_ERROR)
+        error = e;
+      continue;
+    }
+
+    uint8_t *special = find_special(p, end);
+    uint32_t run = (uint32_t)(special - p);
+
+    if (slip->size == 0 && special < end && *special == SLIP_SPECIAL_BYTE_END &&
+        run <= slip->descriptor->buf_size) {
+      e = slip->descriptor->recv_message(p, run) ? SLIP_NO_ERROR : SLIP_ERROR_INVALID_PACKET;
+      p = special + 1;
+    } else {
+      e = put_run_to_buffer(slip, p, run);
+      if (error == SLIP_NO_ERROR)
+        error = e;
+      p = special;
+      if (p == end)
+        break;
+      e = slip_read_byte(slip, *p++);
+    }
+    if (error == SLIP_NO_ERROR)
+      error = e;
+  }
+
+  return error;
+}
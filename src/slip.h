@@ -64,4 +64,11 @@ typedef enum {
 slip_error_t slip_init(slip_handler_s *slip, const slip_descriptor_s *descriptor);
 slip_error_t slip_read_byte(slip_handler_s *slip, uint8_t byte);
 
+/* Decode a whole chunk of received bytes. Runs without END/ESC are found a
+word at a time and copied in bulk; a frame that starts on an empty rx buffer
+and has no escapes is passed to recv_message in place, pointing into 'data'.
+Everything else goes through slip_read_byte(). Returns the first error, but
+like the byte path keeps decoding after it. */
+slip_error_t slip_read_buffer(slip_handler_s *slip, uint8_t *data, uint32_t size);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include "spsc.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Every record is a 32-bit length followed by the message, padded to 4
+// bytes. A record that would cross the end of the buffer is preceded by a pad
+// marker that tells the consumer to skip to the start.
+#define SPSC_PAD 0xFFFFFFFFu
+
+static inline uint32_t record_size(uint32_t n) {
+    return 4 + ((n + 3) & ~3u);
+}
+
+bool spsc_init(SpscRing *r, uint32_t size) {
+    uint32_t pow2 = 64;
+    while (pow2 < size && pow2 < 0x40000000u) pow2 <<= 1;
+    r->buf = malloc(pow2);
+    if (!r->buf) return false;
+    r->size = pow2;
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    return true;
+}
+
+void spsc_free(SpscRing *r) {
+    free(r->buf);
+    r->buf = NULL;
+    r->size = 0;
+}
+
+bool spsc_push2(SpscRing *r, const void *a, uint32_t na, const void *b, uint32_t nb) {
+    uint32_t n = na + nb;
+    uint32_t rec = record_size(n);
+    uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    uint32_t pos = head & (r->size - 1);
+    uint32_t to_end = r->size - pos;
+    uint32_t need = (rec <= to_end) ? rec : to_end + rec;
+    if (rec > r->size || r->size - (head - tail) < need) return false;
+
+    if (rec > to_end) {
+        uint32_t pad = SPSC_PAD;
+        memcpy(r->buf + pos, &pad, 4);
+        head += to_end;
+        pos = 0;
+    }
+    memcpy(r->buf + pos, &n, 4);
+    memcpy(r->buf + pos + 4, a, na);
+    if (nb) memcpy(r->buf + pos + 4 + na, b, nb);
+    // Publish the record only after its bytes are written
+    atomic_store_explicit(&r->head, head + rec, memory_order_release);
+    return true;
+}
+
+bool spsc_push(SpscRing *r, const void *data, uint32_t n) {
+    return spsc_push2(r, data, n, NULL, 0);
+}
+
+uint32_t spsc_peek(SpscRing *r, uint8_t **data) {
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    while (tail != head) {
+        uint32_t pos = tail & (r->size - 1);
+        uint32_t n;
+        memcpy(&n, r->buf + pos, 4);
+        if (n != SPSC_PAD) {
+            *data = r->buf + pos + 4;
+            return n;
+        }
+        tail += r->size - pos;
+        atomic_store_explicit(&r->tail, tail, memory_order_release);
+    }
+    return 0;
+}
+
+void spsc_pop(SpscRing *r) {
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    uint32_t n;
+    memcpy(&n, r->buf + (tail & (r->size - 1)), 4);
+    // Release: the producer may reuse the bytes once it sees the new tail
+    atomic_store_explicit(&r->tail, tail + record_size(n), memory_order_release);
+}
+
+uint32_t spsc_used(SpscRing *r) {
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    uint32_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    return head - tail;
+}
+
+void spsc_reset(SpscRing *r) {
+    atomic_store(&r->head, 0);
+    atomic_store(&r->tail, 0);
+}
@@ -0,0 +1,39 @@
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// Lock-free single-producer/single-consumer ring of variable-sized messages.
+// One thread pushes, one other thread peeks and pops; neither ever blocks.
+// Messages are stored contiguously (a record that would wrap is moved to the
+// start of the buffer), so the consumer can process them in place.
+typedef struct {
+    uint8_t *buf;
+    uint32_t size;             // Bytes, a power of two
+    _Atomic uint32_t head;     // Producer position, free running
+    _Atomic uint32_t tail;     // Consumer position, free running
+} SpscRing;
+
+// 'size' is rounded up to a power of two. Returns false if out of memory.
+bool spsc_init(SpscRing *r, uint32_t size);
+void spsc_free(SpscRing *r);
+
+// Producer: false (and nothing written) when the message does not fit
+bool spsc_push(SpscRing *r, const void *data, uint32_t n);
+// Same, with the message gathered from two parts (e.g. a header and a payload)
+bool spsc_push2(SpscRing *r, const void *a, uint32_t na, const void *b, uint32_t nb);
+
+// Consumer: size of the oldest message and a pointer to it, 0 when empty.
+// The message stays valid until spsc_pop().
+uint32_t spsc_peek(SpscRing *r, uint8_t **data);
+void spsc_pop(SpscRing *r);
+
+// Bytes in use, from either side
+uint32_t spsc_used(SpscRing *r);
+
+// Drop everything. Only while neither side is running.
+void spsc_reset(SpscRing *r);
+
+#endif
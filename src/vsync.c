@@ -0,0 +1,90 @@
+#include "vsync.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <linux/fb.h>
+
+static int vs_fd = -1;
+static int vs_fb_fd = -1;
+static bool vs_threaded = false;
+static atomic_bool vs_running = false;
+static pthread_t vs_thread;
+
+static void* vsync_thread_fn(void* arg) {
+    (void)arg;
+    uint64_t one = 1;
+    while (vs_running) {
+        int dummy = 0;
+        // Keep ticking at ~60 Hz if the driver stops answering, the main loop
+        // only blits when this fd fires
+        if (ioctl(vs_fb_fd, FBIO_WAITFORVSYNC, &dummy) == -1) usleep(16667);
+        if (write(vs_fd, &one, sizeof(one)) < 0) break;
+    }
+    return NULL;
+}
+
+static int start_timer(int hz) {
+    if (hz <= 0) hz = 60;
+    vs_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (vs_fd == -1) return -1;
+
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_interval.tv_nsec = 1000000000L / hz;
+    its.it_value = its.it_interval;
+    timerfd_settime(vs_fd, 0, &its, NULL);
+    printf("Vsync: no FBIO_WAITFORVSYNC, pacing with %d Hz timer\n", hz);
+    return vs_fd;
+}
+
+int vsync_start(int fb_fd, int fallback_hz) {
+    if (vs_fd != -1) return vs_fd;
+    vs_fb_fd = fb_fd;
+
+    // Probe once; unsupported drivers fail immediately with ENOTTY/EINVAL
+    int dummy = 0;
+    if (ioctl(fb_fd, FBIO_WAITFORVSYNC, &dummy) == -1) {
+        return start_timer(fallback_hz);
+    }
+
+    vs_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (vs_fd == -1) return -1;
+
+    vs_running = true;
+    if (pthread_create(&vs_thread, NULL, vsync_thread_fn, NULL) != 0) {
+        vs_running = false;
+        close(vs_fd);
+        vs_fd = -1;
+        return start_timer(fallback_hz);
+    }
+    vs_threaded = true;
+    printf("Vsync: pacing with FBIO_WAITFORVSYNC thread\n");
+    return vs_fd;
+}
+
+void vsync_stop(void) {
+    if (vs_threaded) {
+        vs_running = false;
+        pthread_join(vs_thread, NULL);
+        vs_threaded = false;
+    }
+    if (vs_fd != -1) close(vs_fd);
+    vs_fd = -1;
+}
+
+int vsync_get_fd(void) {
+    return vs_fd;
+}
+
+bool vsync_ack(void) {
+    // eventfd and timerfd both hand out a 64-bit tick count
+    uint64_t ticks = 0;
+    if (vs_fd == -1) return false;
+    return read(vs_fd, &ticks, sizeof(ticks)) == sizeof(ticks) && ticks > 0;
+}
@@ -0,0 +1,18 @@
+#ifndef VSYNC_H
+#define VSYNC_H
+
+#include <stdbool.h>
+
+// Vsync pacing for the main poll loop. A helper thread blocks in
+// FBIO_WAITFORVSYNC and signals each vblank through an eventfd. Drivers
+// without vsync support (fbtft) get a timerfd ticking at fallback_hz instead.
+int vsync_start(int fb_fd, int fallback_hz);
+void vsync_stop(void);
+
+// Pollable fd that becomes readable once per refresh (-1 when not started)
+int vsync_get_fd(void);
+
+// Consume pending ticks. Returns true if at least one vblank was signalled.
+bool vsync_ack(void);
+
+#endif